@@ -0,0 +1,75 @@
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/delay.h>
+#include <string.h>
+
+
+/*
+ *  Register file of the emulated ATmega328P
+ */
+#define HOST_REGISTER_8_DEFINITION(name) volatile uint8_t name;
+#define HOST_REGISTER_16_DEFINITION(name) volatile uint16_t name;
+HOST_REGISTERS(HOST_REGISTER_8_DEFINITION, HOST_REGISTER_16_DEFINITION)
+
+
+/*
+ *  Handlers that the firmware doesn't define do nothing
+ */
+#define HOST_VECTOR_DEFAULT(vector) extern "C" __attribute__((weak)) void vector(void) {}
+HOST_VECTORS(HOST_VECTOR_DEFAULT)
+
+
+/*
+ *  Busy waits take no time, a tool that wants to see the pins during them
+ *  defines its own
+ */
+__attribute__((weak)) void host_delay(void) {}
+
+
+/*
+ *  EEPROM is the EEMEM variables themselves
+ */
+uint8_t eeprom_read_byte(const uint8_t *address) {
+    return *address;
+}
+
+
+uint16_t eeprom_read_word(const uint16_t *address) {
+    return *address;
+}
+
+
+uint32_t eeprom_read_dword(const uint32_t *address) {
+    return *address;
+}
+
+
+void eeprom_read_block(void *destination, const void *source, size_t size) {
+    memcpy(destination, source, size);
+}
+
+
+void eeprom_write_byte(uint8_t *address, uint8_t value) {
+    *address = value;
+}
+
+
+void eeprom_update_byte(uint8_t *address, uint8_t value) {
+    *address = value;
+}
+
+
+void eeprom_update_word(uint16_t *address, uint16_t value) {
+    *address = value;
+}
+
+
+void eeprom_update_dword(uint32_t *address, uint32_t value) {
+    *address = value;
+}
+
+
+void eeprom_update_block(const void *source, void *destination, size_t size) {
+    memmove(destination, source, size);
+}
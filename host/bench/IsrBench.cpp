@@ -0,0 +1,594 @@
+/*
+ *  Interrupt benchmark: the real firmware image (ELF built for the ATmega328P)
+ *  runs instruction by instruction in simavr while the torch/plate model of
+ *  the simulator (host/sim/Plant.h) drives the signal pins and the feedback ADC
+ *  channel through a scripted cutting cycle. Every interrupt is timed in CPU
+ *  cycles:
+ *    - duration: from the vector entry till RETI;
+ *    - latency: from the moment the interrupt flag was raised till the vector
+ *      entry (time spent in other ISRs and in cli() sections);
+ *  and CPU load (cycles awake versus sleeping) is counted. Everything is split
+ *  by the operating mode (firmware's `state` variable, read from the SRAM).
+ *  TOUCH edge is measured separately: till PCINT0 entry and till its RETI (the
+ *  motor has been stopped by then).
+ *
+ *  Results are printed as a table and written as JSON for regression tracking
+ */
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_irq.h>
+#include <simavr/sim_interrupts.h>
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_adc.h>
+#include <libelf.h>
+#include <gelf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Plant.h"
+
+
+#define F_CPU 16000000UL
+#define SECONDS_TO_CYCLES(s) ((avr_cycle_count_t)((s)*F_CPU))
+#define CYCLES_TO_SECONDS(c) ((double)(c)/F_CPU)
+#define AVR_RAM_OFFSET 0x800000
+
+// firmware signal pins (see TorchHeightControl.h), all are active low
+#define BUTTON_PIN 0
+#define TOUCH_PIN 1
+#define UP_PIN 2
+#define DOWN_PIN 3
+#define PLASM_PIN 4
+#define SIGNALS_NUM 5
+// StepDirDriver pins (ZMotorDriver in TorchHeightControl.h)
+#define DIR_PIN 2  // PC2
+#define STEP_PIN 3  // PC3
+#define HW_STEP_PIN 3  // PD3
+#define ADC_REFERENCE_MILLIVOLTS 5000
+
+#define VECTORS_NUM 26
+// latency histogram: bin 0 is 0 cycles, bin n is [2^(n-1), 2^n) cycles, the
+// last one takes everything above
+#define HISTOGRAM_BINS 16
+
+static const char *const vector_names[VECTORS_NUM] = {
+    "RESET", "INT0", "INT1", "PCINT0", "PCINT1", "PCINT2", "WDT",
+    "TIMER2_COMPA", "TIMER2_COMPB", "TIMER2_OVF", "TIMER1_CAPT", "TIMER1_COMPA",
+    "TIMER1_COMPB", "TIMER1_OVF", "TIMER0_COMPA", "TIMER0_COMPB", "TIMER0_OVF",
+    "SPI_STC", "USART_RX", "USART_UDRE", "USART_TX", "ADC", "EE_READY",
+    "ANALOG_COMP", "TWI", "SPM_READY"
+};
+#define PCINT0_VECTOR 3
+
+// values of the firmware `state` variable (enum State)
+#define MODES_NUM 5
+static const char *const mode_names[MODES_NUM+1] = {
+    "idle", "start", "pierce", "define_sp", "work", "unknown"
+};
+
+
+typedef struct {
+    uint64_t count;
+    uint64_t cycles_sum;
+    uint32_t cycles_min;
+    uint32_t cycles_max;
+    uint64_t latency_sum;
+    uint32_t latency_max;
+    uint32_t latency_histogram[HISTOGRAM_BINS];
+} IsrStats;
+
+typedef struct {
+    uint64_t sleep_cycles;
+    uint64_t main_cycles;
+    uint64_t isr_cycles;
+    IsrStats isr[VECTORS_NUM];
+} ModeStats;
+
+
+/*
+ *  Scenario (seconds)
+ */
+static double plasm_on_time = 1.0;
+static double cut_time = 6.0;
+static double idle_time = 1.0;  // after the plasm off, buttons are pressed there
+static double press_time = 0.1;
+
+typedef struct {
+    double time;
+    uint8_t pin;
+    bool active;
+} Stimulus;
+
+static Stimulus stimuli[16];
+static uint8_t stimuli_num = 0, stimuli_next = 0;
+
+static PlantParameters parameters;
+static Plant plant;
+static bool plasm = false;
+
+/*
+ *  simavr
+ */
+static avr_t *avr;
+static avr_irq_t *signal_irqs[SIGNALS_NUM];
+static avr_irq_t *adc_feedback_irq;
+static avr_irq_t *adc_settings_irq;
+static int32_t position = 0;
+static bool direction_up = false;
+static uint32_t state_address = 0;
+
+/*
+ *  Measurements
+ */
+static ModeStats modes[MODES_NUM+1];
+static avr_cycle_count_t raised_at[VECTORS_NUM];
+static bool raised[VECTORS_NUM];
+static int8_t current_vector = -1;
+static uint8_t current_mode = 0;
+static avr_cycle_count_t isr_entry;
+static uint32_t isr_latency;
+// TOUCH edge to PCINT0 entry and to its exit
+static avr_cycle_count_t touch_edge_at;
+static bool touch_pending = false;
+static IsrStats touch_entry, touch_exit;
+
+
+static void stats_init(IsrStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->cycles_min = UINT32_MAX;
+}
+
+
+static uint8_t histogram_bin(uint32_t cycles) {
+    uint8_t bin = 0;
+    while (cycles && bin < HISTOGRAM_BINS-1) {
+        cycles >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+
+static void stats_add(IsrStats *stats, uint32_t cycles, uint32_t latency) {
+    stats->count++;
+    stats->cycles_sum += cycles;
+    if (cycles < stats->cycles_min)
+        stats->cycles_min = cycles;
+    if (cycles > stats->cycles_max)
+        stats->cycles_max = cycles;
+    stats->latency_sum += latency;
+    if (latency > stats->latency_max)
+        stats->latency_max = latency;
+    stats->latency_histogram[histogram_bin(latency)]++;
+}
+
+
+static void stats_merge(IsrStats *to, const IsrStats *from) {
+    to->count += from->count;
+    to->cycles_sum += from->cycles_sum;
+    if (from->cycles_min < to->cycles_min)
+        to->cycles_min = from->cycles_min;
+    if (from->cycles_max > to->cycles_max)
+        to->cycles_max = from->cycles_max;
+    to->latency_sum += from->latency_sum;
+    if (from->latency_max > to->latency_max)
+        to->latency_max = from->latency_max;
+    for (uint8_t i = 0; i < HISTOGRAM_BINS; i++)
+        to->latency_histogram[i] += from->latency_histogram[i];
+}
+
+
+static uint8_t firmware_mode(void) {
+    uint8_t state = avr->data[state_address];
+    return state < MODES_NUM ? state : MODES_NUM;
+}
+
+
+static uint32_t symbol_address(const char *file, const char *name) {
+    uint32_t address = 0;
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    elf_version(EV_CURRENT);
+    Elf *elf = elf_begin(fd, ELF_C_READ, NULL);
+    Elf_Scn *section = NULL;
+    while ( elf && (section = elf_nextscn(elf, section)) ) {
+        GElf_Shdr header;
+        gelf_getshdr(section, &header);
+        if (header.sh_type != SHT_SYMTAB)
+            continue;
+        Elf_Data *data = elf_getdata(section, NULL);
+        size_t count = header.sh_size/header.sh_entsize;
+        for (size_t i = 0; i < count; i++) {
+            GElf_Sym symbol;
+            gelf_getsym(data, i, &symbol);
+            if (strcmp(elf_strptr(elf, header.sh_link, symbol.st_name), name) == 0)
+                address = symbol.st_value;
+        }
+    }
+    if (elf)
+        elf_end(elf);
+    close(fd);
+    return address;
+}
+
+
+/*
+ *  Model coupling
+ */
+static void set_signal(uint8_t pin, bool active) {
+    avr_raise_irq(signal_irqs[pin], !active);
+}
+
+
+static void update_touch(void) {
+    static bool touch = false;
+    bool now_touch = plant_touch(&plant, &parameters);
+    if (now_touch == touch)
+        return;
+    touch = now_touch;
+    if (touch) {
+        touch_edge_at = avr->cycle;
+        touch_pending = true;
+    }
+    set_signal(TOUCH_PIN, touch);
+}
+
+
+static void step_notify(avr_irq_t *irq, uint32_t value, void *param) {
+    (void)irq;
+    (void)param;
+    if (!value)
+        return;
+    position += direction_up ? 1 : -1;
+    plant_advance(&plant, &parameters, CYCLES_TO_SECONDS(avr->cycle));
+    plant_step(&plant, &parameters, position);
+    update_touch();
+}
+
+
+static void direction_notify(avr_irq_t *irq, uint32_t value, void *param) {
+    (void)irq;
+    (void)param;
+    direction_up = value;
+}
+
+
+// ADC is about to convert: give it fresh voltages
+static void adc_trigger_notify(avr_irq_t *irq, uint32_t value, void *param) {
+    (void)irq;
+    (void)value;
+    (void)param;
+    plant_advance(&plant, &parameters, CYCLES_TO_SECONDS(avr->cycle));
+    double millivolts = 1000*plant_arc_voltage(&plant, &parameters, plasm)/parameters.divider;
+    if (millivolts > ADC_REFERENCE_MILLIVOLTS)
+        millivolts = ADC_REFERENCE_MILLIVOLTS;
+    avr_raise_irq(adc_feedback_irq, (uint32_t)millivolts);
+    avr_raise_irq(adc_settings_irq, (uint32_t)(parameters.potentiometer*ADC_REFERENCE_MILLIVOLTS));
+    update_touch();
+}
+
+
+// interrupt flag is raised (1) or cleared (0)
+static void vector_notify(avr_irq_t *irq, uint32_t value, void *param) {
+    (void)irq;
+    uint8_t vector = (uintptr_t)param;
+    if (value && !raised[vector]) {
+        raised[vector] = true;
+        raised_at[vector] = avr->cycle;
+    }
+    else if (!value) {
+        raised[vector] = false;
+    }
+}
+
+
+/*
+ *  Called after every instruction: notice vector entries and RETIs
+ */
+static void track_interrupts(void) {
+    if (current_vector < 0) {
+        if (avr->sreg[S_I] || avr->pc == 0 || avr->pc >= VECTORS_NUM*avr->vector_size)
+            return;
+        current_vector = avr->pc/avr->vector_size;
+        current_mode = firmware_mode();
+        isr_entry = avr->cycle;
+        isr_latency = raised_at[current_vector] <= avr->cycle ? avr->cycle - raised_at[current_vector] : 0;
+        if (current_vector == PCINT0_VECTOR && touch_pending)
+            stats_add(&touch_entry, 0, avr->cycle - touch_edge_at);
+    }
+    else if (avr->sreg[S_I]) {
+        stats_add(&modes[current_mode].isr[current_vector], avr->cycle - isr_entry, isr_latency);
+        if (current_vector == PCINT0_VECTOR && touch_pending) {
+            stats_add(&touch_exit, 0, avr->cycle - touch_edge_at);
+            touch_pending = false;
+        }
+        current_vector = -1;
+    }
+}
+
+
+static void add_stimulus(double time, uint8_t pin, bool active) {
+    stimuli[stimuli_num].time = time;
+    stimuli[stimuli_num].pin = pin;
+    stimuli[stimuli_num].active = active;
+    stimuli_num++;
+}
+
+
+/*
+ *  Cutting cycle, then a tour over the settings menu and manual up/down in
+ *  idle. Stimuli go in time order
+ */
+static void build_scenario(void) {
+    double t = plasm_on_time;
+    add_stimulus(t, PLASM_PIN, true);
+    t += cut_time;
+    add_stimulus(t, PLASM_PIN, false);
+    t += idle_time/2;
+    for (uint8_t i = 0; i < 3; i++) {
+        add_stimulus(t, BUTTON_PIN, true);
+        add_stimulus(t+press_time, BUTTON_PIN, false);
+        t += 2*press_time;
+    }
+    add_stimulus(t, UP_PIN, true);
+    add_stimulus(t+press_time, UP_PIN, false);
+    t += 2*press_time;
+    add_stimulus(t, DOWN_PIN, true);
+    add_stimulus(t+press_time, DOWN_PIN, false);
+}
+
+
+static void apply_stimuli(void) {
+    while ( stimuli_next < stimuli_num &&
+            avr->cycle >= SECONDS_TO_CYCLES(stimuli[stimuli_next].time) ) {
+        const Stimulus *stimulus = &stimuli[stimuli_next++];
+        if (stimulus->pin == PLASM_PIN)
+            plasm = stimulus->active;
+        set_signal(stimulus->pin, stimulus->active);
+    }
+}
+
+
+/*
+ *  Output
+ */
+static void print_isr_json(FILE *file, const IsrStats *stats) {
+    fprintf(file, "{\"count\": %llu, \"cycles_min\": %u, \"cycles_avg\": %.1f, \"cycles_max\": %u, "
+            "\"latency_avg\": %.1f, \"latency_max\": %u, \"latency_histogram\": [",
+            (unsigned long long)stats->count, stats->count ? stats->cycles_min : 0,
+            stats->count ? (double)stats->cycles_sum/stats->count : 0, stats->cycles_max,
+            stats->count ? (double)stats->latency_sum/stats->count : 0, stats->latency_max);
+    for (uint8_t i = 0; i < HISTOGRAM_BINS; i++)
+        fprintf(file, "%s%u", i ? ", " : "", stats->latency_histogram[i]);
+    fprintf(file, "]}");
+}
+
+
+static void print_isrs_json(FILE *file, const IsrStats *isr, const char *indent) {
+    bool first = true;
+    fprintf(file, "{");
+    for (uint8_t v = 0; v < VECTORS_NUM; v++) {
+        if (!isr[v].count)
+            continue;
+        fprintf(file, "%s\n%s  \"%s\": ", first ? "" : ",", indent, vector_names[v]);
+        print_isr_json(file, &isr[v]);
+        first = false;
+    }
+    fprintf(file, "\n%s}", indent);
+}
+
+
+static double cpu_load(const ModeStats *mode) {
+    uint64_t total = mode->sleep_cycles + mode->main_cycles + mode->isr_cycles;
+    return total ? 100.0*(mode->main_cycles + mode->isr_cycles)/total : 0;
+}
+
+
+static void write_json(FILE *file, const char *firmware_file) {
+    ModeStats total;
+    memset(&total, 0, sizeof(total));
+    for (uint8_t v = 0; v < VECTORS_NUM; v++)
+        stats_init(&total.isr[v]);
+    for (uint8_t m = 0; m <= MODES_NUM; m++) {
+        total.sleep_cycles += modes[m].sleep_cycles;
+        total.main_cycles += modes[m].main_cycles;
+        total.isr_cycles += modes[m].isr_cycles;
+        for (uint8_t v = 0; v < VECTORS_NUM; v++)
+            stats_merge(&total.isr[v], &modes[m].isr[v]);
+    }
+
+    fprintf(file, "{\n  \"firmware\": \"%s\",\n  \"f_cpu\": %lu,\n  \"cycles\": %llu,\n",
+            firmware_file, F_CPU, (unsigned long long)avr->cycle);
+    fprintf(file, "  \"histogram_bins\": \"bin 0 is 0 cycles, bin n is [2^(n-1), 2^n) cycles\",\n");
+    fprintf(file, "  \"cpu_load\": %.3f,\n  \"isr\": ", cpu_load(&total));
+    print_isrs_json(file, total.isr, "  ");
+    fprintf(file, ",\n  \"touch\": {\"to_entry\": ");
+    print_isr_json(file, &touch_entry);
+    fprintf(file, ", \"to_exit\": ");
+    print_isr_json(file, &touch_exit);
+    fprintf(file, "},\n  \"modes\": {");
+    bool first = true;
+    for (uint8_t m = 0; m <= MODES_NUM; m++) {
+        const ModeStats *mode = &modes[m];
+        uint64_t cycles = mode->sleep_cycles + mode->main_cycles + mode->isr_cycles;
+        if (!cycles)
+            continue;
+        fprintf(file, "%s\n    \"%s\": {\"cycles\": %llu, \"isr_cycles\": %llu, \"main_cycles\": %llu, "
+                "\"cpu_load\": %.3f,\n      \"isr\": ", first ? "" : ",", mode_names[m],
+                (unsigned long long)cycles, (unsigned long long)mode->isr_cycles,
+                (unsigned long long)mode->main_cycles, cpu_load(mode));
+        print_isrs_json(file, mode->isr, "      ");
+        fprintf(file, "}");
+        first = false;
+    }
+    fprintf(file, "\n  }\n}\n");
+}
+
+
+static void print_table(void) {
+    printf("%-10s %-13s %8s %6s %8s %6s %8s %6s %7s\n", "mode", "isr", "count", "min",
+           "avg", "max", "lat.avg", "lat.max", "load%");
+    for (uint8_t m = 0; m <= MODES_NUM; m++) {
+        const ModeStats *mode = &modes[m];
+        if (!(mode->sleep_cycles + mode->main_cycles + mode->isr_cycles))
+            continue;
+        printf("%-10s %-13s %8s %6s %8s %6s %8s %6s %7.2f\n", mode_names[m], "", "", "", "", "",
+               "", "", cpu_load(mode));
+        for (uint8_t v = 0; v < VECTORS_NUM; v++) {
+            const IsrStats *isr = &mode->isr[v];
+            if (!isr->count)
+                continue;
+            printf("%-10s %-13s %8llu %6u %8.1f %6u %8.1f %6u\n", "", vector_names[v],
+                   (unsigned long long)isr->count, isr->cycles_min,
+                   (double)isr->cycles_sum/isr->count, isr->cycles_max,
+                   (double)isr->latency_sum/isr->count, isr->latency_max);
+        }
+    }
+    if (touch_exit.count)
+        printf("touch edge: to PCINT0 entry avg %.1f max %u cycles, to RETI avg %.1f max %u cycles\n",
+               (double)touch_entry.latency_sum/touch_entry.count, touch_entry.latency_max,
+               (double)touch_exit.latency_sum/touch_exit.count, touch_exit.latency_max);
+    else
+        printf("touch edge: never serviced\n");
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options] firmware.elf\n"
+           "  --out FILE   JSON results (isr_bench.json)\n"
+           "  --time S     cutting time (%.1f s)\n"
+           "  --seed N     random seed (%llu)\n"
+           "  --noise V    arc voltage noise, standard deviation (%.2f V)\n"
+           "  --spikes N   arc voltage spikes per second (%.2f)\n",
+           name, cut_time, (unsigned long long)parameters.seed, parameters.noise,
+           parameters.spike_rate);
+}
+
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"out", required_argument, NULL, 'o'},
+        {"time", required_argument, NULL, 't'},
+        {"seed", required_argument, NULL, 'r'},
+        {"noise", required_argument, NULL, 'n'},
+        {"spikes", required_argument, NULL, 's'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *out_file = "isr_bench.json";
+
+    plant_defaults(&parameters);
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'o': out_file = optarg; break;
+            case 't': cut_time = atof(optarg); break;
+            case 'r': parameters.seed = strtoull(optarg, NULL, 0); break;
+            case 'n': parameters.noise = atof(optarg); break;
+            case 's': parameters.spike_rate = atof(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc-1) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char *firmware_file = argv[optind];
+
+    elf_firmware_t firmware;
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(firmware_file, &firmware) != 0) {
+        fprintf(stderr, "can't read %s\n", firmware_file);
+        return 1;
+    }
+    if (!firmware.mmcu[0])
+        strcpy(firmware.mmcu, "atmega328p");
+    if (!firmware.frequency)
+        firmware.frequency = F_CPU;
+    state_address = symbol_address(firmware_file, "state");
+    if (!state_address) {
+        fprintf(stderr, "no `state` symbol in %s\n", firmware_file);
+        return 1;
+    }
+    state_address -= AVR_RAM_OFFSET;
+
+    avr = avr_make_mcu_by_name(firmware.mmcu);
+    if (!avr) {
+        fprintf(stderr, "simavr doesn't know %s\n", firmware.mmcu);
+        return 1;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->vcc = avr->avcc = avr->aref = ADC_REFERENCE_MILLIVOLTS;
+
+    for (uint8_t pin = 0; pin < SIGNALS_NUM; pin++) {
+        signal_irqs[pin] = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('B'), pin);
+        avr_raise_irq(signal_irqs[pin], 1);  // pull-ups
+    }
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), STEP_PIN),
+                            step_notify, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), HW_STEP_PIN),
+                            step_notify, NULL);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('C'), DIR_PIN),
+                            direction_notify, NULL);
+    adc_feedback_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC1);
+    adc_settings_irq = avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_ADC0);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_ADC_GETIRQ, ADC_IRQ_OUT_TRIGGER),
+                            adc_trigger_notify, NULL);
+    for (uintptr_t v = 1; v < VECTORS_NUM; v++) {
+        avr_irq_t *irq = avr_get_interrupt_irq(avr, v);
+        if (irq)
+            avr_irq_register_notify(irq, vector_notify, (void *)v);
+    }
+
+    for (uint8_t m = 0; m <= MODES_NUM; m++)
+        for (uint8_t v = 0; v < VECTORS_NUM; v++)
+            stats_init(&modes[m].isr[v]);
+    stats_init(&touch_entry);
+    stats_init(&touch_exit);
+
+    plant_init(&plant, &parameters, 0);
+    build_scenario();
+    avr_cycle_count_t end = SECONDS_TO_CYCLES(stimuli[stimuli_num-1].time + idle_time/2);
+
+    while (avr->cycle < end) {
+        apply_stimuli();
+
+        avr_cycle_count_t before = avr->cycle;
+        bool sleeping = avr->state == cpu_Sleeping;
+        bool in_isr = current_vector >= 0;
+        uint8_t mode = in_isr ? current_mode : firmware_mode();
+
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed) {
+            fprintf(stderr, "firmware has stopped at %.6f s, pc 0x%04x\n",
+                    CYCLES_TO_SECONDS(avr->cycle), (unsigned)avr->pc);
+            return 1;
+        }
+
+        avr_cycle_count_t cycles = avr->cycle - before;
+        if (sleeping)
+            modes[mode].sleep_cycles += cycles;
+        else if (in_isr)
+            modes[mode].isr_cycles += cycles;
+        else
+            modes[mode].main_cycles += cycles;
+        track_interrupts();
+    }
+
+    print_table();
+    FILE *file = fopen(out_file, "w");
+    if (!file) {
+        fprintf(stderr, "can't write %s\n", out_file);
+        return 1;
+    }
+    write_json(file, firmware_file);
+    fclose(file);
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+
+
+/*
+ *  Host (Linux) replacement of the Arduino core header. The firmware uses only
+ *  AVR and C standard library parts of it
+ */
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <util/delay.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+
+#endif /* Arduino_h */
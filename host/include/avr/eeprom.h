@@ -0,0 +1,29 @@
+#ifndef _AVR_EEPROM_H_
+#define _AVR_EEPROM_H_
+
+
+
+/*
+ *  Host build: EEMEM variables are ordinary ones initialized by their default
+ *  values, i.e. it's like EEPROM has been just flashed with the .eep image
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#define EEMEM
+
+uint8_t eeprom_read_byte(const uint8_t *address);
+uint16_t eeprom_read_word(const uint16_t *address);
+uint32_t eeprom_read_dword(const uint32_t *address);
+void eeprom_read_block(void *destination, const void *source, size_t size);
+void eeprom_write_byte(uint8_t *address, uint8_t value);
+void eeprom_update_byte(uint8_t *address, uint8_t value);
+void eeprom_update_word(uint16_t *address, uint16_t value);
+void eeprom_update_dword(uint32_t *address, uint32_t value);
+void eeprom_update_block(const void *source, void *destination, size_t size);
+#define eeprom_write_word eeprom_update_word
+#define eeprom_write_block eeprom_update_block
+
+
+
+#endif /* _AVR_EEPROM_H_ */
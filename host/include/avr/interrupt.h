@@ -0,0 +1,51 @@
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+
+
+
+/*
+ *  Host (Linux) build: interrupt handlers are ordinary functions. Host tools call
+ *  them when the emulated peripheral fires. Every vector has an empty weak
+ *  default (see host/avr/HostAVR.cpp) so tools may call any of them
+ */
+#include <avr/io.h>
+
+#define ISR(vector, ...) extern "C" void vector(void); extern "C" void vector(void)
+#define ISR_NOBLOCK
+
+// there is no concurrency on the host: handlers are called only while the
+// firmware sleeps
+#define sei() ((void)0)
+#define cli() ((void)0)
+
+#define PCINT0_vect __vector_PCINT0
+#define PCINT1_vect __vector_PCINT1
+#define PCINT2_vect __vector_PCINT2
+#define TIMER2_COMPA_vect __vector_TIMER2_COMPA
+#define TIMER2_COMPB_vect __vector_TIMER2_COMPB
+#define TIMER2_OVF_vect __vector_TIMER2_OVF
+#define TIMER1_CAPT_vect __vector_TIMER1_CAPT
+#define TIMER1_COMPA_vect __vector_TIMER1_COMPA
+#define TIMER1_COMPB_vect __vector_TIMER1_COMPB
+#define TIMER1_OVF_vect __vector_TIMER1_OVF
+#define TIMER0_COMPA_vect __vector_TIMER0_COMPA
+#define TIMER0_COMPB_vect __vector_TIMER0_COMPB
+#define TIMER0_OVF_vect __vector_TIMER0_OVF
+#define USART_RX_vect __vector_USART_RX
+#define USART_UDRE_vect __vector_USART_UDRE
+#define USART_TX_vect __vector_USART_TX
+#define ADC_vect __vector_ADC
+
+#define HOST_VECTORS(V) \
+    V(PCINT0_vect) V(PCINT1_vect) V(PCINT2_vect) \
+    V(TIMER2_COMPA_vect) V(TIMER2_COMPB_vect) V(TIMER2_OVF_vect) \
+    V(TIMER1_CAPT_vect) V(TIMER1_COMPA_vect) V(TIMER1_COMPB_vect) V(TIMER1_OVF_vect) \
+    V(TIMER0_COMPA_vect) V(TIMER0_COMPB_vect) V(TIMER0_OVF_vect) \
+    V(USART_RX_vect) V(USART_UDRE_vect) V(USART_TX_vect) V(ADC_vect)
+
+#define HOST_VECTOR_DECLARATION(vector) extern "C" void vector(void);
+HOST_VECTORS(HOST_VECTOR_DECLARATION)
+
+
+
+#endif /* _AVR_INTERRUPT_H_ */
@@ -0,0 +1,183 @@
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+
+
+
+/*
+ *  Host (Linux) build: ATmega328P registers are plain variables (see
+ *  host/avr/HostAVR.cpp). Firmware reads and writes them as usual and host tools
+ *  look at them to emulate the peripherals
+ */
+#include <stdint.h>
+
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+#endif
+
+#define HOST_REGISTERS(R8, R16) \
+    R8(PINB) R8(DDRB) R8(PORTB) R8(PINC) R8(DDRC) R8(PORTC) R8(PIND) R8(DDRD) R8(PORTD) \
+    R8(ADCSRA) R8(ADCSRB) R8(ADMUX) R16(ADC) R8(DIDR0) \
+    R8(TCCR0A) R8(TCCR0B) R8(TCNT0) R8(OCR0A) R8(OCR0B) R8(TIMSK0) R8(TIFR0) \
+    R8(TCCR1A) R8(TCCR1B) R8(TCCR1C) R16(TCNT1) R16(OCR1A) R16(OCR1B) R16(ICR1) R8(TIMSK1) R8(TIFR1) \
+    R8(TCCR2A) R8(TCCR2B) R8(TCNT2) R8(OCR2A) R8(OCR2B) R8(TIMSK2) R8(TIFR2) R8(ASSR) R8(GTCCR) \
+    R8(PCICR) R8(PCIFR) R8(PCMSK0) R8(PCMSK1) R8(PCMSK2) \
+    R8(UCSR0A) R8(UCSR0B) R8(UCSR0C) R16(UBRR0) R8(UDR0) \
+    R8(SMCR) R8(MCUSR) R8(SREG) R16(SP)
+
+#define HOST_REGISTER_8(name) extern volatile uint8_t name;
+#define HOST_REGISTER_16(name) extern volatile uint16_t name;
+HOST_REGISTERS(HOST_REGISTER_8, HOST_REGISTER_16)
+
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+#define _BV(bit) (1<<(bit))
+
+// Port pins
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PC6 6
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// ADC
+#define ADPS0 0
+#define ADPS1 1
+#define ADPS2 2
+#define ADIE 3
+#define ADIF 4
+#define ADATE 5
+#define ADSC 6
+#define ADEN 7
+#define ADTS0 0
+#define ADTS1 1
+#define ADTS2 2
+#define MUX0 0
+#define MUX1 1
+#define MUX2 2
+#define MUX3 3
+#define ADLAR 5
+#define REFS0 6
+#define REFS1 7
+
+// Timer0
+#define WGM00 0
+#define WGM01 1
+#define COM0B0 4
+#define COM0B1 5
+#define COM0A0 6
+#define COM0A1 7
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM02 3
+#define TOIE0 0
+#define OCIE0A 1
+#define OCIE0B 2
+#define TOV0 0
+#define OCF0A 1
+#define OCF0B 2
+
+// Timer1
+#define WGM10 0
+#define WGM11 1
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define ICES1 6
+#define ICNC1 7
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define ICIE1 5
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+#define ICF1 5
+
+// Timer2
+#define WGM20 0
+#define WGM21 1
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A0 6
+#define COM2A1 7
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM22 3
+#define TOIE2 0
+#define OCIE2A 1
+#define OCIE2B 2
+#define TOV2 0
+#define OCF2A 1
+#define OCF2B 2
+#define PSRASY 1
+
+// Pin change interrupts
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+#define PCINT0 0
+#define PCINT1 1
+#define PCINT2 2
+#define PCINT3 3
+#define PCINT4 4
+#define PCINT5 5
+#define PCINT6 6
+#define PCINT7 7
+#define PCINT16 0
+#define PCINT17 1
+
+// USART0
+#define MPCM0 0
+#define U2X0 1
+#define UDRE0 5
+#define TXC0 6
+#define RXC0 7
+#define TXB80 0
+#define UCSZ02 2
+#define TXEN0 3
+#define RXEN0 4
+#define UDRIE0 5
+#define TXCIE0 6
+#define RXCIE0 7
+#define UCSZ00 1
+#define UCSZ01 2
+
+// Sleep mode control
+#define SE 0
+#define SM0 1
+#define SM1 2
+#define SM2 3
+
+
+
+#endif /* _AVR_IO_H_ */
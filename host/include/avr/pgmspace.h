@@ -0,0 +1,17 @@
+#ifndef __PGMSPACE_H_
+#define __PGMSPACE_H_
+
+
+
+#include <stdint.h>
+
+// there is only one address space on the host
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+
+
+
+#endif /* __PGMSPACE_H_ */
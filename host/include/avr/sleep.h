@@ -0,0 +1,21 @@
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+
+
+
+#include <avr/io.h>
+
+#define SLEEP_MODE_IDLE 0
+
+#define set_sleep_mode(mode) ((void)(mode))
+#define sleep_enable() ((void)0)
+#define sleep_disable() ((void)0)
+
+// Host build: the tool advances its time to the next interrupt and calls the
+// handler. Each host tool has to define it
+void host_sleep(void);
+#define sleep_cpu() host_sleep()
+
+
+
+#endif /* _AVR_SLEEP_H_ */
@@ -0,0 +1,13 @@
+#ifndef _UTIL_ATOMIC_H_
+#define _UTIL_ATOMIC_H_
+
+
+
+// Host build: interrupt handlers never preempt the firmware (see avr/interrupt.h)
+#define ATOMIC_BLOCK(type) for (uint8_t host_atomic_once = 1; host_atomic_once; host_atomic_once = 0)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+
+
+
+#endif /* _UTIL_ATOMIC_H_ */
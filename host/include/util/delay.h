@@ -0,0 +1,14 @@
+#ifndef _UTIL_DELAY_H_
+#define _UTIL_DELAY_H_
+
+
+
+// Host build: busy waits take no emulated time. A tool may look at the pins
+// during them (e.g. a STEP pulse lasts only for the delay), see host_delay()
+void host_delay(void);
+#define _delay_ms(ms) ((void)(ms), host_delay())
+#define _delay_us(us) ((void)(us), host_delay())
+
+
+
+#endif /* _UTIL_DELAY_H_ */
@@ -0,0 +1,370 @@
+/*
+ *  Replay of the recorded arc voltage traces through the control algorithm of
+ *  the firmware (lib/Regulator, with the same filter and setpoint definition,
+ *  built for the host with the same configuration). Deterministic: the same
+ *  traces and settings always give the same commands, so the output of a
+ *  firmware change can be compared against the golden output of the previous
+ *  one.
+ *
+ *  Trace is either:
+ *    - a file of raw 10-bit samples (uint16, little endian), one cut per file,
+ *      samples are split into the control ticks by the sampling and control
+ *      rates;
+ *    - a directory written by the telemetry decoder (--columns): samples are
+ *      split into ticks exactly as the firmware has seen them (by frames) and a
+ *      new cut starts at every setpoint definition.
+ *  Traces are memory-mapped so they may be as large as the address space is.
+ *
+ *  Output is one int16 (little endian) per control tick: motor command in
+ *  steps/s or NO_COMMAND while the setpoint is being defined
+ */
+#include <Regulator.h>
+#include <ADC.h>
+#include <Motor.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+
+#define NO_COMMAND INT16_MIN
+// firmware's state in the telemetry frames (enum State in TorchHeightControl.h)
+#define DEFINE_SP_STATE 3
+
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+} MappedFile;
+
+static RegulatorSettings settings = {
+    20,  // setpoint_offset, EEPROM default
+#ifdef PID_REGULATION
+    MOTOR_MAX_SPEED,
+#else
+    MOTOR_SPEED,
+#endif
+    MS_TO_TICKS(SETPOINT_MIN_TIME),
+    MS_TO_TICKS(SETPOINT_MAX_TIME),
+    SETPOINT_TOLERANCE,
+#ifdef PID_REGULATION
+    320, 2, 0,  // gains, EEPROM defaults
+#endif
+#ifdef SLOPE_CORRECTION
+    0  // slope, unknown
+#endif
+};
+static uint32_t sample_rate = ADC_FEEDBACK_RATE;
+
+static std::vector<int16_t> commands;
+static uint64_t samples_total = 0, bytes_total = 0, cuts = 0, defined_ticks = 0;
+static uint64_t reversals = 0;
+static int16_t last_direction = 0;
+
+
+static bool map_file(const char *path, MappedFile *file) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    file->size = st.st_size;
+    file->data = NULL;
+    if (file->size) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(path);
+            close(fd);
+            return false;
+        }
+        madvise(data, file->size, MADV_SEQUENTIAL);
+        file->data = (const uint8_t *)data;
+    }
+    close(fd);
+    bytes_total += file->size;
+    return true;
+}
+
+
+static void unmap_file(MappedFile *file) {
+    if (file->size)
+        munmap((void *)file->data, file->size);
+}
+
+
+static inline uint16_t get16(const uint8_t *p) {
+    return p[0] | (uint16_t)p[1]<<8;
+}
+
+
+static inline uint32_t get32(const uint8_t *p) {
+    return get16(p) | (uint32_t)get16(p+2)<<16;
+}
+
+
+static void start_cut(void) {
+    regulator_start(&settings);
+    cuts++;
+}
+
+
+static void tick(void) {
+    int16_t command;
+    if (regulator_tick(&command) == REGULATOR_DEFINING_SETPOINT) {
+        commands.push_back(NO_COMMAND);
+        return;
+    }
+    commands.push_back(command);
+    defined_ticks++;
+
+    int16_t direction = command > 0 ? 1 : command < 0 ? -1 : 0;
+    if (direction) {
+        if (last_direction && direction != last_direction)
+            reversals++;
+        last_direction = direction;
+    }
+}
+
+
+// plain samples, ticks by the rates (as many samples as the ADC gives per tick)
+static bool replay_samples(const char *path) {
+    MappedFile file;
+    if (!map_file(path, &file))
+        return false;
+
+    uint64_t count = file.size/2;
+    uint64_t next = 0;
+    start_cut();
+    last_direction = 0;
+    for (uint64_t ticks = 1; next < count; ticks++) {
+        uint64_t end = ticks*sample_rate/CONTROL_RATE;
+        if (end > count)
+            end = count;
+        for (; next < end; next++) {
+            uint16_t sample = get16(&file.data[2*next]);
+        #ifdef ANTI_DIVE
+            regulator_watch(sample);
+        #endif
+            regulator_sample(sample);
+        }
+        tick();
+    }
+    samples_total += count;
+
+    unmap_file(&file);
+    return true;
+}
+
+
+// telemetry decoder output: raw.u16, frame.u32 and state.u8 columns
+static bool replay_columns(const char *dir) {
+    MappedFile raw, frame, state;
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/raw.u16", dir);
+    if (!map_file(path, &raw))
+        return false;
+    snprintf(path, sizeof(path), "%s/frame.u32", dir);
+    if (!map_file(path, &frame))
+        return false;
+    snprintf(path, sizeof(path), "%s/state.u8", dir);
+    if (!map_file(path, &state))
+        return false;
+
+    uint64_t count = raw.size/2;
+    if (frame.size/4 != count || state.size != count) {
+        fprintf(stderr, "%s: columns have different lengths\n", dir);
+        return false;
+    }
+
+    bool started = false;
+    uint8_t last_state = 0;
+    for (uint64_t i = 0; i < count; ) {
+        uint32_t frame_number = get32(&frame.data[4*i]);
+        uint8_t frame_state = state.data[i];
+        if ( frame_state == DEFINE_SP_STATE && (!started || last_state != DEFINE_SP_STATE) ) {
+            start_cut();
+            last_direction = 0;
+            started = true;
+        }
+        last_state = frame_state;
+
+        // all rows of the frame are the samples of one tick (a frame without
+        // samples has a single row with 0xFFFF)
+        for (; i < count && get32(&frame.data[4*i]) == frame_number; i++) {
+            uint16_t sample = get16(&raw.data[2*i]);
+            if (started && sample != 0xFFFF) {
+            #ifdef ANTI_DIVE
+                regulator_watch(sample);
+            #endif
+                regulator_sample(sample);
+            }
+        }
+        if (started)
+            tick();
+    }
+    samples_total += count;
+
+    unmap_file(&raw);
+    unmap_file(&frame);
+    unmap_file(&state);
+    return true;
+}
+
+
+static bool write_commands(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    for (size_t i = 0; i < commands.size(); i++) {
+        uint8_t bytes[2] = {(uint8_t)commands[i], (uint8_t)((uint16_t)commands[i]>>8)};
+        fwrite(bytes, 2, 1, file);
+    }
+    fclose(file);
+    return true;
+}
+
+
+// Returns the number of differing ticks (length difference counts as well)
+static uint64_t compare_golden(const char *path) {
+    MappedFile golden;
+    if (!map_file(path, &golden))
+        return UINT64_MAX;
+    bytes_total -= golden.size;
+
+    uint64_t golden_ticks = golden.size/2;
+    uint64_t common = golden_ticks < commands.size() ? golden_ticks : commands.size();
+    uint64_t differences = 0, first = UINT64_MAX;
+    for (uint64_t i = 0; i < common; i++) {
+        if ((int16_t)get16(&golden.data[2*i]) != commands[i]) {
+            if (first == UINT64_MAX)
+                first = i;
+            differences++;
+        }
+    }
+    if (golden_ticks != commands.size()) {
+        fprintf(stderr, "golden has %llu ticks, replay %llu\n",
+                (unsigned long long)golden_ticks, (unsigned long long)commands.size());
+        if (first == UINT64_MAX)
+            first = common;
+        differences += golden_ticks > common ? golden_ticks-common : commands.size()-common;
+    }
+    if (differences)
+        fprintf(stderr, "%llu ticks differ from %s, the first one is %llu (golden %d, replay %d)\n",
+                (unsigned long long)differences, path, (unsigned long long)first,
+                first < golden_ticks ? (int16_t)get16(&golden.data[2*first]) : 0,
+                first < commands.size() ? commands[first] : 0);
+    else
+        fprintf(stderr, "identical to %s\n", path);
+
+    unmap_file(&golden);
+    return differences;
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options] trace...\n"
+           "  --out FILE         write commands (int16 per control tick)\n"
+           "  --golden FILE      compare commands with FILE, exit code 2 if they differ\n"
+           "  --offset N         setpoint offset, 10-bit ADC units (%u)\n"
+           "  --speed N          motor speed (PID output limit), steps/s (%d)\n"
+           "  --setpoint-min N   minimal setpoint definition time, ticks (%u)\n"
+           "  --setpoint-max N   maximal setpoint definition time, ticks (%u)\n"
+           "  --tolerance N      setpoint definition tolerance, FILTER_BITS-bit units (%u)\n"
+#ifdef PID_REGULATION
+           "  --kp N --ki N --kd N  PID gains (%u %u %u)\n"
+#endif
+           "  --sample-rate N    feedback samples per second of plain traces (%u)\n"
+           "Trace is a file of uint16 samples or a telemetry decoder columns directory\n",
+           name, settings.setpoint_offset, settings.speed, settings.setpoint_min_ticks,
+           settings.setpoint_max_ticks, settings.setpoint_tolerance,
+#ifdef PID_REGULATION
+           settings.kp, settings.ki, settings.kd,
+#endif
+           sample_rate);
+}
+
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"out", required_argument, NULL, 'o'},
+        {"golden", required_argument, NULL, 'g'},
+        {"offset", required_argument, NULL, 'f'},
+        {"speed", required_argument, NULL, 's'},
+        {"setpoint-min", required_argument, NULL, 'm'},
+        {"setpoint-max", required_argument, NULL, 'M'},
+        {"tolerance", required_argument, NULL, 't'},
+#ifdef PID_REGULATION
+        {"kp", required_argument, NULL, 'p'},
+        {"ki", required_argument, NULL, 'i'},
+        {"kd", required_argument, NULL, 'd'},
+#endif
+        {"sample-rate", required_argument, NULL, 'r'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *out_file = NULL, *golden_file = NULL;
+
+    int option;
+    while ( (option = getopt_long(argc, argv, "", options, NULL)) != -1 ) {
+        switch (option) {
+            case 'o': out_file = optarg; break;
+            case 'g': golden_file = optarg; break;
+            case 'f': settings.setpoint_offset = atoi(optarg); break;
+            case 's': settings.speed = atoi(optarg); break;
+            case 'm': settings.setpoint_min_ticks = atoi(optarg); break;
+            case 'M': settings.setpoint_max_ticks = atoi(optarg); break;
+            case 't': settings.setpoint_tolerance = atoi(optarg); break;
+        #ifdef PID_REGULATION
+            case 'p': settings.kp = atoi(optarg); break;
+            case 'i': settings.ki = atoi(optarg); break;
+            case 'd': settings.kd = atoi(optarg); break;
+        #endif
+            case 'r': sample_rate = atoi(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = optind; i < argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) != 0) {
+            perror(argv[i]);
+            return 1;
+        }
+        if ( !(S_ISDIR(st.st_mode) ? replay_columns(argv[i]) : replay_samples(argv[i])) )
+            return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)*1e-9;
+
+    fprintf(stderr, "%llu cuts, %llu samples, %llu ticks (%llu with commands), %llu reversals\n",
+            (unsigned long long)cuts, (unsigned long long)samples_total,
+            (unsigned long long)commands.size(), (unsigned long long)defined_ticks,
+            (unsigned long long)reversals);
+    fprintf(stderr, "%.3f s, %.2f GB/min, %.0fx real time\n", seconds,
+            seconds > 0 ? bytes_total/seconds*60/1e9 : 0,
+            seconds > 0 ? (double)commands.size()/CONTROL_RATE/seconds : 0);
+
+    if (out_file && !write_commands(out_file))
+        return 1;
+    if (golden_file && compare_golden(golden_file))
+        return 2;
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "Plant.h"
+#include <math.h>
+
+
+// s, the warp is linear within (sin() on every event would take a fifth of the
+// simulation time), the error is below 1e-6 mm for any sensible warp
+#define WARP_SEGMENT 0.001
+
+
+void plant_defaults(PlantParameters *parameters) {
+    parameters->arc_voltage_0 = 90.0;
+    parameters->arc_slope = 8.0;
+    parameters->divider = 50.0;
+    parameters->adc_reference = 5.0;
+    parameters->noise = 1.0;
+    parameters->spike_rate = 1.0;
+    parameters->spike_voltage = 40.0;
+    parameters->spike_duration = 0.001;
+    parameters->warp_amplitude = 1.0;
+    parameters->warp_length = 1000.0;
+    parameters->feed_rate = 2000.0/60;
+    parameters->step_height = 0.5;
+    parameters->step_time = 10.0;
+    parameters->mm_per_step = 0.01;
+    parameters->max_step_rate = 5000.0;
+    parameters->start_height = 10.0;
+    parameters->potentiometer = 0.5;
+    parameters->seed = 1;
+}
+
+
+void plant_init(Plant *plant, const PlantParameters *parameters, int32_t motor_position) {
+    plant->time = 0;
+    plant->warp_start = -1;
+    plant->plate_z = plant_plate_z(parameters, 0);
+    plant->torch_z = plant->plate_z + parameters->start_height;
+    plant->colliding = false;
+    plant->gaussian_ready = false;
+    plant->motor_position = motor_position;
+    plant->last_step_time = -1;
+    plant->spike_end = -1;
+    plant->last_sample_time = 0;
+    plant->steps = 0;
+    plant->lost_steps = 0;
+    plant->collisions = 0;
+    plant->random_state = parameters->seed ? parameters->seed : 1;
+}
+
+
+// xorshift64*, same sequence on every host for the same seed
+static double random_uniform(Plant *plant) {
+    plant->random_state ^= plant->random_state >> 12;
+    plant->random_state ^= plant->random_state << 25;
+    plant->random_state ^= plant->random_state >> 27;
+    uint64_t value = plant->random_state * 0x2545F4914F6CDD1DULL;
+    return ((value >> 11) + 0.5) * (1.0/9007199254740992.0);
+}
+
+
+// Box-Muller, gives two values at once
+static double random_gaussian(Plant *plant) {
+    if (plant->gaussian_ready) {
+        plant->gaussian_ready = false;
+        return plant->gaussian_next;
+    }
+    double radius = sqrt(-2*log(random_uniform(plant)));
+    double angle = 2*M_PI*random_uniform(plant);
+    plant->gaussian_next = radius*sin(angle);
+    plant->gaussian_ready = true;
+    return radius*cos(angle);
+}
+
+
+static double warp_z(const PlantParameters *parameters, double time) {
+    if (parameters->warp_length <= 0)
+        return 0;
+    return parameters->warp_amplitude *
+           sin(2*M_PI*parameters->feed_rate*time/parameters->warp_length);
+}
+
+
+double plant_plate_z(const PlantParameters *parameters, double time) {
+    double z = warp_z(parameters, time);
+    if (time >= parameters->step_time)
+        z += parameters->step_height;
+    return z;
+}
+
+
+double plant_height(const Plant *plant, const PlantParameters *parameters) {
+    (void)parameters;
+    return plant->torch_z - plant->plate_z;
+}
+
+
+bool plant_touch(const Plant *plant, const PlantParameters *parameters) {
+    return plant_height(plant, parameters) <= 0;
+}
+
+
+// rising plate pushes the torch up (floating head)
+void plant_advance(Plant *plant, const PlantParameters *parameters, double time) {
+    plant->time = time;
+    if ( !(time >= plant->warp_start && time < plant->warp_start+WARP_SEGMENT) ) {
+        plant->warp_start = floor(time/WARP_SEGMENT)*WARP_SEGMENT;
+        plant->warp_z = warp_z(parameters, plant->warp_start);
+        plant->warp_slope = (warp_z(parameters, plant->warp_start+WARP_SEGMENT) -
+                             plant->warp_z)/WARP_SEGMENT;
+    }
+    plant->plate_z = plant->warp_z + plant->warp_slope*(time-plant->warp_start);
+    if (time >= parameters->step_time)
+        plant->plate_z += parameters->step_height;
+    if (plant->torch_z < plant->plate_z) {
+        if (!plant->colliding)
+            plant->collisions++;
+        plant->colliding = true;
+        plant->torch_z = plant->plate_z;
+    }
+    else {
+        plant->colliding = plant->torch_z == plant->plate_z;
+    }
+}
+
+
+void plant_step(Plant *plant, const PlantParameters *parameters, int32_t motor_position) {
+    while (plant->motor_position != motor_position) {
+        int8_t direction = motor_position > plant->motor_position ? 1 : -1;
+        plant->motor_position += direction;
+        plant->steps++;
+
+        // motor stalls if it is driven too fast, torch can't go through the plate
+        bool too_fast = (plant->time - plant->last_step_time) < 1/parameters->max_step_rate;
+        plant->last_step_time = plant->time;
+        if ( too_fast || (direction < 0 && plant_touch(plant, parameters)) ) {
+            plant->lost_steps++;
+            continue;
+        }
+        plant->torch_z += direction*parameters->mm_per_step;
+    }
+}
+
+
+double plant_arc_voltage(Plant *plant, const PlantParameters *parameters, bool plasm) {
+    if (!plasm)
+        return 0;
+
+    double height = plant_height(plant, parameters);
+    if (height < 0)
+        height = 0;
+    double voltage = parameters->arc_voltage_0 + parameters->arc_slope*height;
+
+    voltage += parameters->noise*random_gaussian(plant);
+    if (plant->time < plant->spike_end) {
+        voltage += parameters->spike_voltage;
+    }
+    else if (parameters->spike_rate > 0) {
+        // chance of a new spike since the previous sample, rate is low so it's
+        // fine to check it per sample
+        double interval = plant->time - plant->last_sample_time;
+        if (random_uniform(plant) < parameters->spike_rate*interval)
+            plant->spike_end = plant->time + parameters->spike_duration;
+    }
+    plant->last_sample_time = plant->time;
+    return voltage > 0 ? voltage : 0;
+}
+
+
+uint16_t plant_feedback_adc(Plant *plant, const PlantParameters *parameters, bool plasm) {
+    double pin_voltage = plant_arc_voltage(plant, parameters, plasm)/parameters->divider;
+    long value = lround(pin_voltage/parameters->adc_reference*1023);
+    if (value < 0)
+        value = 0;
+    else if (value > 1023)
+        value = 1023;
+    return value;
+}
@@ -0,0 +1,83 @@
+#ifndef PLANT_H_
+#define PLANT_H_
+
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ *  Model of everything outside the controller: Z axis with the stepper motor,
+ *  the plate under the torch and the arc between them. Heights are in mm, times
+ *  are in seconds, voltages in volts
+ */
+typedef struct {
+    // arc voltage is arc_voltage_0 + arc_slope*height
+    double arc_voltage_0;
+    double arc_slope;  // V/mm
+    // arc volts per FEEDBACK pin volt (voltage divider)
+    double divider;
+    double adc_reference;  // V
+    // gaussian noise (standard deviation) and random spikes of the arc voltage
+    double noise;  // V
+    double spike_rate;  // per second
+    double spike_voltage;  // V
+    double spike_duration;  // s
+    // warped plate: sine wave along the cut
+    double warp_amplitude;  // mm
+    double warp_length;  // mm
+    double feed_rate;  // mm/s
+    // plate (or its height) suddenly changes at step_time
+    double step_height;  // mm
+    double step_time;  // s
+    // Z axis
+    double mm_per_step;
+    double max_step_rate;  // steps/s, faster steps are lost
+    double start_height;  // mm
+    // settings potentiometer position, 0-1
+    double potentiometer;
+    uint64_t seed;
+} PlantParameters;
+
+
+typedef struct {
+    double torch_z;  // mm, absolute
+    double plate_z;  // mm, at the current time
+    // warp segment the time is in: its start, the warp there and the slope
+    double warp_start;
+    double warp_z;
+    double warp_slope;
+    bool colliding;
+    double time;  // s
+    int32_t motor_position;  // steps the driver has made
+    double last_step_time;
+    double spike_end;
+    double last_sample_time;
+    uint32_t steps;
+    uint32_t lost_steps;
+    uint32_t collisions;  // plate has pushed the torch up
+    uint64_t random_state;
+    double gaussian_next;
+    bool gaussian_ready;
+} Plant;
+
+
+void plant_defaults(PlantParameters *parameters);
+void plant_init(Plant *plant, const PlantParameters *parameters, int32_t motor_position);
+// move the model time forward
+void plant_advance(Plant *plant, const PlantParameters *parameters, double time);
+// driver has made some steps (new motor position)
+void plant_step(Plant *plant, const PlantParameters *parameters, int32_t motor_position);
+
+double plant_plate_z(const PlantParameters *parameters, double time);
+double plant_height(const Plant *plant, const PlantParameters *parameters);
+bool plant_touch(const Plant *plant, const PlantParameters *parameters);
+// arc voltage (0 if there is no arc)
+double plant_arc_voltage(Plant *plant, const PlantParameters *parameters, bool plasm);
+// 10-bit result of the conversion of the FEEDBACK pin
+uint16_t plant_feedback_adc(Plant *plant, const PlantParameters *parameters, bool plasm);
+
+
+
+#endif /* PLANT_H_ */
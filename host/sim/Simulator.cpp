@@ -0,0 +1,708 @@
+/*
+ *  Closed-loop simulator: the firmware (src/ and lib/) built for the host runs
+ *  against emulated ATmega328P peripherals (Timer0, Timer2, ADC, pin change
+ *  interrupts, UART transmitter) which in turn are coupled to the model of the torch, arc and
+ *  plate (Plant.h). Time is counted in CPU cycles and jumps from one interrupt
+ *  to the next one while the firmware sleeps, so code of the main loop takes no
+ *  time and the simulation runs much faster than the real time.
+ *
+ *  The plant is moved by what the motor driver puts out (STEP pulses with the
+ *  DIR level, OC2B pulses of the hardware step mode or the coil patterns), not by
+ *  the position the firmware counts, so a driver that counts a step it hasn't
+ *  made shows up as the drift of the height and in the miscounted steps. The
+ *  driver is chosen by --driver to match ZMotorDriver of the build (the
+ *  microstep mode of PhaseDriver needs Timer1 which isn't emulated).
+ *
+ *  Firmware's main() is renamed to firmware_main() by the build flags and is
+ *  called from here. It never returns: simulation ends in host_sleep()
+ */
+#undef main
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <StepPlanner.h>
+#include "Plant.h"
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+int firmware_main(void);
+
+// firmware state we look at for the statistics
+extern bool setpoint_defined;
+
+#define NEVER UINT64_MAX
+#define SECONDS_TO_CYCLES(s) ((uint64_t)((s)*F_CPU))
+#define CYCLES_TO_SECONDS(c) ((double)(c)/F_CPU)
+
+// firmware signal pins (see TorchHeightControl.h), all are active low
+#define TOUCH_PIN PB1
+#define UP_PIN PB2
+#define PLASM_PIN PB4
+// motor driver pins (see ZMotorDriver in TorchHeightControl.h), all are on PORTC,
+// STEP of the hardware step mode is OC2B
+#define DIR_PIN PC2
+#define STEP_PIN PC3
+#define PHASE_FIRST_PIN PC2
+#define OC2B_PIN PD3
+
+enum Driver {
+    STEP_DIR_DRIVER,
+    HW_STEP_DIR_DRIVER,
+    PHASE_DRIVER,  // wave and full step modes
+    HALF_STEP_DRIVER
+};
+static const char *const driver_names[] = {"step-dir", "hw-step-dir", "phase", "half-step"};
+
+
+/*
+ *  Scenario
+ */
+static PlantParameters parameters;
+static Plant plant;
+static double plasm_on_time = 0.5;  // s
+static double cut_time = 30.0;  // s
+static double settle_band = 0.1;  // mm
+// Several cuts: the CNC holds Up for travel_lift after each one and starts the
+// next one travel_time after the plasm off
+static uint16_t cuts = 1;
+static double travel_time = 2.0;  // s
+static double travel_lift = 1.0;  // s
+// contact bounce of the plasm relay: extra edges after each change
+static uint8_t bounces = 0;
+static uint8_t bounces_left = 0;
+static uint64_t bounce_cycle = NEVER;
+#define BOUNCE_PERIOD 0.0005  // s
+static FILE *trace = NULL;
+// everything the firmware sends through the UART (telemetry)
+static FILE *uart = NULL;
+// scenario events, NEVER when done
+static uint64_t plasm_on_cycle, plasm_off_cycle, up_on_cycle = NEVER, up_off_cycle = NEVER, end_cycle;
+static bool plasm = false;
+static uint16_t cuts_done = 0;
+
+/*
+ *  Emulated peripherals
+ */
+static uint64_t now = 0;
+static uint64_t timer0_next = NEVER;
+// compare match interrupt: A in CTC mode, B in fast PWM mode
+static uint64_t timer2_next = NEVER;
+// fast PWM mode: the counter wraps to BOTTOM, OC2B is set
+static uint64_t timer2_bottom = NEVER;
+// TCNT2 as the emulation has left it, the firmware has restarted the counter if
+// it differs
+static uint8_t timer2_count = 0;
+static uint64_t adc_next = NEVER;
+static uint64_t uart_next = NEVER;
+static uint8_t adc_channel;
+
+/*
+ *  Statistics of the cutting (from the setpoint definition till the plasm off)
+ */
+static bool working = false;
+static uint16_t cuts_worked = 0;
+static double work_start, first_height, reference_height;
+// touch-off: from the plasm on till the (last) touch before the setpoint
+static double cut_start, touch_time;
+static double touch_off_sum = 0, touch_off_max = 0;
+static uint32_t error_cnt = 0;
+static double error_sum_sq = 0, error_max = 0;
+static double step_error_peak = 0, settling_time = 0;
+static bool step_seen = false, settled = false;
+static int32_t last_position;
+static int8_t last_direction = 0;
+static uint32_t reversals = 0, touches = 0;
+
+/*
+ *  Motor: steps the driver has really made, the plant follows them
+ */
+static uint8_t driver = STEP_DIR_DRIVER;
+static int32_t motor_steps = 0;
+static bool step_pin = false;
+// half-step of the energized coils (0-7), -1 - they haven't been energized yet
+static int8_t coil_phase = -1;
+
+
+static uint16_t timer0_prescaler(void) {
+    static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    return prescalers[TCCR0B & 0x07];
+}
+
+
+static uint16_t timer2_prescaler(void) {
+    static const uint16_t prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+    return prescalers[TCCR2B & 0x07];
+}
+
+
+// one 8N1 frame
+static uint32_t uart_byte_cycles(void) {
+    return 10*((UCSR0A & (1<<U2X0)) ? 8 : 16)*(UBRR0+1);
+}
+
+
+static uint8_t adc_prescaler(void) {
+    static const uint8_t prescalers[8] = {2, 2, 4, 8, 16, 32, 64, 128};
+    return prescalers[ADCSRA & 0x07];
+}
+
+
+/*
+ *  Look at the registers the firmware may have changed and (un)schedule the
+ *  peripherals. A timer started anew counts from now
+ */
+static void update_schedule(void) {
+    // interrupts are taken at once, so no flag is ever left pending
+    // (the firmware clears them writing ones, which would set them here)
+    TIFR2 = 0;
+
+    if ( (TIMSK0 & (1<<OCIE0A)) && timer0_prescaler() ) {
+        if (timer0_next == NEVER)
+            timer0_next = now + (uint64_t)timer0_prescaler()*(OCR0A+1);
+    }
+    else {
+        timer0_next = NEVER;
+    }
+
+    if ( (TIMSK2 & ((1<<OCIE2A)|(1<<OCIE2B))) && timer2_prescaler() ) {
+        if (TCNT2 != timer2_count) {
+            timer2_next = NEVER;
+            timer2_bottom = NEVER;
+        }
+        if (TCCR2B & (1<<WGM22)) {
+            // fast PWM: counts on from TCNT2 to TOP (or to MAX if it's above TOP)
+            if (timer2_bottom == NEVER) {
+                timer2_bottom = now + (uint64_t)timer2_prescaler()*((TCNT2 <= OCR2A ? OCR2A : 0xFF)-TCNT2+1);
+                timer2_next = TCNT2 < OCR2B ? now + (uint64_t)timer2_prescaler()*(OCR2B-TCNT2) : NEVER;
+            }
+        }
+        else if (timer2_next == NEVER) {
+            timer2_next = now + (uint64_t)timer2_prescaler()*(OCR2A-TCNT2+1);
+        }
+    }
+    else {
+        timer2_next = NEVER;
+        timer2_bottom = NEVER;
+    }
+    // OC2B level is seen in PIND while it's connected
+    if ( !(TCCR2A & (1<<COM2B1)) || timer2_bottom == NEVER )
+        PIND &= ~(1<<OC2B_PIN);
+
+    // data register empty interrupt comes a byte time after the previous one
+    if ( (UCSR0B & (1<<TXEN0)) && (UCSR0B & (1<<UDRIE0)) ) {
+        if (uart_next == NEVER)
+            uart_next = now + uart_byte_cycles();
+    }
+    else {
+        uart_next = NEVER;
+    }
+
+    if ( (ADCSRA & (1<<ADEN)) && (ADCSRA & (1<<ADSC)) ) {
+        if (adc_next == NEVER) {
+            adc_channel = ADMUX & 0x0F;
+            adc_next = now + 13*adc_prescaler();
+        }
+    }
+    else {
+        adc_next = NEVER;
+    }
+}
+
+
+// TCNT2 at the current time (it's left as it is while the timer is stopped)
+static void update_timer2_count(void) {
+    uint64_t next = TCCR2B & (1<<WGM22) ? timer2_bottom : timer2_next;
+    if (next == NEVER || !timer2_prescaler())
+        return;
+    uint64_t ticks = (next-now)/timer2_prescaler();
+    TCNT2 = (ticks == 0 || ticks > OCR2A) ? 0 : OCR2A+1-ticks;
+    timer2_count = TCNT2;
+}
+
+
+static void set_pin(uint8_t pin, bool high) {
+    uint8_t old = PINB;
+    if (high)
+        PINB |= (1<<pin);
+    else
+        PINB &= ~(1<<pin);
+
+    if ( ((old ^ PINB) & PCMSK0) && (PCICR & (1<<PCIE0)) )
+        PCINT0_vect();
+}
+
+
+static void motor_step(int8_t direction) {
+    motor_steps += direction;
+    plant_step(&plant, &parameters, motor_steps);
+}
+
+
+// half-step (0-7) of the pattern of the coil pins, -1 if none
+static int8_t pattern_phase(uint8_t pins) {
+    for (uint8_t phase = 0; phase < 8; phase++) {
+        uint8_t pattern = phase%2 ? (1<<phase/2) | (1<<(phase/2+1)%4) : 1<<phase/2;
+        if (pins == pattern)
+            return phase;
+    }
+    return -1;
+}
+
+
+/*
+ *  Look at the pins of the motor driver after everything the firmware does:
+ *  a rising edge of STEP is a step in the direction of DIR, a new coil pattern
+ *  turns the rotor to it. De-energized coils keep the rotor where it is
+ */
+static void watch_motor(void) {
+    if (driver == STEP_DIR_DRIVER) {
+        bool step = PORTC & (1<<STEP_PIN);
+        if (step && !step_pin)
+            motor_step(PORTC & (1<<DIR_PIN) ? 1 : -1);
+        step_pin = step;
+    }
+    else if (driver == PHASE_DRIVER || driver == HALF_STEP_DRIVER) {
+        int8_t phase = pattern_phase( (PORTC >> PHASE_FIRST_PIN) & 0x0F );
+        if (phase < 0)
+            return;
+        if (coil_phase >= 0) {
+            // the rotor follows up to a quarter of the electrical period, the
+            // opposite patterns stall it
+            int8_t half_steps = (phase-coil_phase) & 7;
+            if (half_steps > 4)
+                half_steps -= 8;
+            if (half_steps > 2 || half_steps < -2) {
+                plant.lost_steps++;
+                half_steps = 0;
+            }
+            else if (driver == PHASE_DRIVER) {
+                half_steps /= 2;
+            }
+            for (; half_steps > 0; half_steps--)
+                motor_step(1);
+            for (; half_steps < 0; half_steps++)
+                motor_step(-1);
+        }
+        else {
+            // the rotor has been anywhere since the power-up, the first pattern
+            // only aligns it: both counts start here
+            motor_steps = planner_position();
+            plant.motor_position = motor_steps;
+        }
+        coil_phase = phase;
+    }
+}
+
+
+// STEP pulses of the software drivers last for a busy wait
+void host_delay(void) {
+    watch_motor();
+}
+
+
+static void start_bounce(void) {
+    bounces_left = 2*bounces;
+    if (bounces_left)
+        bounce_cycle = now + SECONDS_TO_CYCLES(BOUNCE_PERIOD);
+}
+
+
+// true if the touch signal has changed
+static bool update_touch(void) {
+    bool touch = plant_touch(&plant, &parameters);
+    if ( touch == !(PINB & (1<<TOUCH_PIN)) )
+        return false;
+    if (touch && working)
+        touches++;
+    if (touch && plasm && !working)
+        touch_time = CYCLES_TO_SECONDS(now);
+    set_pin(TOUCH_PIN, !touch);
+    return true;
+}
+
+
+static void collect_statistics(void) {
+    double height = plant_height(&plant, &parameters);
+    double time = CYCLES_TO_SECONDS(now);
+
+    if (trace)
+        fprintf(trace, "%.4f,%.4f,%.4f,%d,%d\n", time, plant.torch_z,
+                plant_plate_z(&parameters, time), plant.motor_position, setpoint_defined);
+
+    if (!working) {
+        if (!setpoint_defined || !plasm)
+            return;
+        working = true;
+        if (!cuts_worked) {
+            work_start = time;
+            first_height = height;
+        }
+        cuts_worked++;
+        reference_height = height;
+        last_position = plant.motor_position;
+        last_direction = 0;
+
+        double touch_off = touch_time - cut_start;
+        touch_off_sum += touch_off;
+        if (touch_off > touch_off_max)
+            touch_off_max = touch_off;
+    }
+    if (!plasm) {
+        working = false;
+        return;
+    }
+
+    double error = height - reference_height;
+    error_cnt++;
+    error_sum_sq += error*error;
+    if (fabs(error) > error_max)
+        error_max = fabs(error);
+
+    // Response to the plate step: height error starts at -step_height so the
+    // overshoot is the error of the opposite sign
+    if ( parameters.step_height != 0 && time >= parameters.step_time &&
+         parameters.step_time > work_start ) {
+        step_seen = true;
+        double overshoot = parameters.step_height > 0 ? error : -error;
+        if (overshoot > step_error_peak)
+            step_error_peak = overshoot;
+        if (fabs(error) > settle_band) {
+            settling_time = time - parameters.step_time;
+            settled = false;
+        }
+        else {
+            settled = true;
+        }
+    }
+
+    int32_t delta = plant.motor_position - last_position;
+    last_position = plant.motor_position;
+    if (delta) {
+        int8_t direction = delta > 0 ? 1 : -1;
+        if (last_direction && direction != last_direction)
+            reversals++;
+        last_direction = direction;
+    }
+}
+
+
+// wall clock at the start of the simulation
+static struct timespec wall_start;
+
+
+static void report(double wall_time) {
+    double time = CYCLES_TO_SECONDS(now);
+
+    printf("simulated: %.1f s in %.3f s (%.0fx real time)\n", time, wall_time,
+           wall_time > 0 ? time/wall_time : 0);
+    if (!cuts_worked) {
+        printf("setpoint: never defined\n");
+        return;
+    }
+    printf("setpoint defined: %.3f s after plasm on, height %.3f mm\n",
+           work_start-plasm_on_time, first_height);
+    printf("touch-off: %.3f s avg, %.3f s max (%u of %u cuts)\n", touch_off_sum/cuts_worked,
+           touch_off_max, cuts_worked, cuts);
+    printf("height error: rms %.4f mm, max %.4f mm\n",
+           error_cnt ? sqrt(error_sum_sq/error_cnt) : 0, error_max);
+    if (step_seen && settled)
+        printf("plate step %.2f mm at %.1f s: overshoot %.1f %%, settling %.3f s (band %.2f mm)\n",
+               parameters.step_height, parameters.step_time,
+               100*step_error_peak/fabs(parameters.step_height), settling_time, settle_band);
+    else if (step_seen)
+        printf("plate step %.2f mm at %.1f s: overshoot %.1f %%, not settled (band %.2f mm)\n",
+               parameters.step_height, parameters.step_time,
+               100*step_error_peak/fabs(parameters.step_height), settle_band);
+    else
+        printf("plate step: none during the cut\n");
+    // positive: the firmware thinks the torch is higher than it is
+    printf("motor: %u steps, %u lost, %d miscounted, %u reversals, %u touches, %u collisions\n",
+           plant.steps, plant.lost_steps, planner_position()-motor_steps, reversals, touches,
+           plant.collisions);
+}
+
+
+/*
+ *  Run the next event of the peripherals and the plant, returns true if it was
+ *  only an ADC conversion
+ */
+static bool run_next_event(void) {
+    bool conversion = false;
+
+    update_schedule();
+
+    uint64_t next = end_cycle;
+    if (plasm_on_cycle < next)
+        next = plasm_on_cycle;
+    if (plasm_off_cycle < next)
+        next = plasm_off_cycle;
+    if (up_on_cycle < next)
+        next = up_on_cycle;
+    if (up_off_cycle < next)
+        next = up_off_cycle;
+    if (bounce_cycle < next)
+        next = bounce_cycle;
+    if (timer0_next < next)
+        next = timer0_next;
+    if (timer2_next < next)
+        next = timer2_next;
+    if (timer2_bottom < next)
+        next = timer2_bottom;
+    if (adc_next < next)
+        next = adc_next;
+    if (uart_next < next)
+        next = uart_next;
+
+    now = next;
+    plant_advance(&plant, &parameters, CYCLES_TO_SECONDS(now));
+    update_timer2_count();
+
+    if (now == end_cycle) {
+        struct timespec wall_end;
+        clock_gettime(CLOCK_MONOTONIC, &wall_end);
+        report( (wall_end.tv_sec-wall_start.tv_sec) + (wall_end.tv_nsec-wall_start.tv_nsec)*1e-9 );
+        if (trace)
+            fclose(trace);
+        if (uart)
+            fclose(uart);
+        exit(0);
+    }
+
+    if (now == adc_next) {
+        adc_next = NEVER;
+        conversion = true;
+        if (adc_channel == 1)
+            ADC = plant_feedback_adc(&plant, &parameters, plasm);
+        else
+            ADC = lround(parameters.potentiometer*1023);
+        ADCSRA &= ~(1<<ADSC);
+        if (ADCSRA & (1<<ADIE))
+            ADC_vect();
+    }
+    else if (now == timer0_next) {
+        timer0_next += (uint64_t)timer0_prescaler()*(OCR0A+1);
+        TIMER0_COMPA_vect();
+        collect_statistics();
+    }
+    else if (now == timer2_bottom) {
+        timer2_bottom += (uint64_t)timer2_prescaler()*(OCR2A+1);
+        timer2_next = now + (uint64_t)timer2_prescaler()*OCR2B;
+        // OC2B is set: STEP pulse of the hardware step mode
+        if (TCCR2A & (1<<COM2B1)) {
+            PIND |= (1<<OC2B_PIN);
+            if (driver == HW_STEP_DIR_DRIVER)
+                motor_step(PORTC & (1<<DIR_PIN) ? 1 : -1);
+        }
+    }
+    else if (now == timer2_next) {
+        timer2_next = NEVER;
+        if (TCCR2B & (1<<WGM22)) {
+            // OC2B is cleared
+            PIND &= ~(1<<OC2B_PIN);
+            if (TIMSK2 & (1<<OCIE2B))
+                TIMER2_COMPB_vect();
+        }
+        else if (TIMSK2 & (1<<OCIE2A)) {
+            TIMER2_COMPA_vect();
+        }
+    }
+    else if (now == uart_next) {
+        uart_next = NEVER;
+        USART_UDRE_vect();
+        if (uart)
+            fputc(UDR0, uart);
+    }
+    else if (now == plasm_on_cycle) {
+        plasm_on_cycle = NEVER;
+        plasm_off_cycle = now + SECONDS_TO_CYCLES(cut_time);
+        plasm = true;
+        cut_start = CYCLES_TO_SECONDS(now);
+        set_pin(PLASM_PIN, false);
+        start_bounce();
+    }
+    else if (now == plasm_off_cycle) {
+        plasm_off_cycle = NEVER;
+        plasm = false;
+        set_pin(PLASM_PIN, true);
+        start_bounce();
+        if (++cuts_done < cuts) {
+            // after the plasm debouncing
+            up_on_cycle = now + SECONDS_TO_CYCLES(0.1);
+            up_off_cycle = up_on_cycle + SECONDS_TO_CYCLES(travel_lift);
+            plasm_on_cycle = now + SECONDS_TO_CYCLES(travel_time);
+        }
+        else {
+            end_cycle = now + SECONDS_TO_CYCLES(0.5);
+        }
+    }
+    else if (now == up_on_cycle) {
+        up_on_cycle = NEVER;
+        set_pin(UP_PIN, false);
+    }
+    else if (now == up_off_cycle) {
+        up_off_cycle = NEVER;
+        set_pin(UP_PIN, true);
+    }
+    else if (now == bounce_cycle) {
+        // toggles in pairs so the pin ends at the plasm state
+        set_pin(PLASM_PIN, --bounces_left % 2 ? plasm : !plasm);
+        bounce_cycle = bounces_left ? now + SECONDS_TO_CYCLES(BOUNCE_PERIOD) : NEVER;
+    }
+
+    watch_motor();
+    if ( update_touch() )
+        conversion = false;
+    return conversion;
+}
+
+
+/*
+ *  Firmware has nothing to do: run the next interrupt. The ADC interrupt only
+ *  stores the sample (the anti-dive hook may stop the motor as well) and posts
+ *  no events, so the main loop would go straight back to sleep after it: the
+ *  conversions are run one after another here till any other event comes
+ */
+void host_sleep(void) {
+    if (now == 0)
+        clock_gettime(CLOCK_MONOTONIC, &wall_start);
+
+    while ( run_next_event() )
+        ;
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options]\n"
+           "  --time S         cutting time (%.1f s)\n"
+           "  --cuts N         number of cuts (%u)\n"
+           "  --travel S       time from one cut till the next one (%.1f s)\n"
+           "  --travel-lift S  Up signal time after each cut (%.1f s)\n"
+           "  --bounce N       plasm relay bounces after each change (%u)\n"
+           "  --seed N         random seed (%llu)\n"
+           "  --noise V        arc voltage noise, standard deviation (%.2f V)\n"
+           "  --spikes N       arc voltage spikes per second (%.2f)\n"
+           "  --spike V        spike voltage (%.1f V)\n"
+           "  --spike-time S   spike duration, e.g. crossing a kerf (%.3f s)\n"
+           "  --slope V        arc voltage per mm of height (%.2f V/mm)\n"
+           "  --divider N      arc voltage divider ratio (%.1f)\n"
+           "  --warp MM        plate warp amplitude (%.2f mm)\n"
+           "  --warp-length MM plate warp wavelength (%.0f mm)\n"
+           "  --feed MM/MIN    cutting feed rate (%.0f mm/min)\n"
+           "  --step MM        plate step height (%.2f mm)\n"
+           "  --step-time S    time of the plate step (%.1f s)\n"
+           "  --max-rate N     steps per second the motor can do (%.0f)\n"
+           "  --driver NAME    ZMotorDriver of the build: step-dir, hw-step-dir, phase (wave\n"
+           "                   or full step) or half-step (%s)\n"
+           "  --band MM        settling band (%.2f mm)\n"
+           "  --trace FILE     write time,torch_z,plate_z,position,working on every control tick\n"
+           "  --uart FILE      write everything the firmware sends through the UART\n",
+           name, cut_time, cuts, travel_time, travel_lift, bounces, (unsigned long long)parameters.seed, parameters.noise, parameters.spike_rate,
+           parameters.spike_voltage, parameters.spike_duration, parameters.arc_slope, parameters.divider, parameters.warp_amplitude,
+           parameters.warp_length, parameters.feed_rate*60, parameters.step_height, parameters.step_time,
+           parameters.max_step_rate, driver_names[driver], settle_band);
+}
+
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"time", required_argument, NULL, 't'},
+        {"cuts", required_argument, NULL, 'c'},
+        {"travel", required_argument, NULL, 'T'},
+        {"travel-lift", required_argument, NULL, 'L'},
+        {"bounce", required_argument, NULL, 'B'},
+        {"seed", required_argument, NULL, 'r'},
+        {"noise", required_argument, NULL, 'n'},
+        {"spikes", required_argument, NULL, 's'},
+        {"spike", required_argument, NULL, 'v'},
+        {"spike-time", required_argument, NULL, 'D'},
+        {"slope", required_argument, NULL, 'k'},
+        {"divider", required_argument, NULL, 'd'},
+        {"warp", required_argument, NULL, 'w'},
+        {"warp-length", required_argument, NULL, 'l'},
+        {"feed", required_argument, NULL, 'f'},
+        {"step", required_argument, NULL, 'h'},
+        {"step-time", required_argument, NULL, 'p'},
+        {"max-rate", required_argument, NULL, 'm'},
+        {"driver", required_argument, NULL, 'M'},
+        {"band", required_argument, NULL, 'b'},
+        {"trace", required_argument, NULL, 'o'},
+        {"uart", required_argument, NULL, 'u'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+
+    plant_defaults(&parameters);
+
+    int option;
+    while ( (option = getopt_long(argc, argv, "", options, NULL)) != -1 ) {
+        switch (option) {
+            case 't': cut_time = atof(optarg); break;
+            case 'c': cuts = atoi(optarg); break;
+            case 'T': travel_time = atof(optarg); break;
+            case 'L': travel_lift = atof(optarg); break;
+            case 'B': bounces = atoi(optarg); break;
+            case 'r': parameters.seed = strtoull(optarg, NULL, 0); break;
+            case 'n': parameters.noise = atof(optarg); break;
+            case 's': parameters.spike_rate = atof(optarg); break;
+            case 'v': parameters.spike_voltage = atof(optarg); break;
+            case 'D': parameters.spike_duration = atof(optarg); break;
+            case 'k': parameters.arc_slope = atof(optarg); break;
+            case 'd': parameters.divider = atof(optarg); break;
+            case 'w': parameters.warp_amplitude = atof(optarg); break;
+            case 'l': parameters.warp_length = atof(optarg); break;
+            case 'f': parameters.feed_rate = atof(optarg)/60; break;
+            case 'h': parameters.step_height = atof(optarg); break;
+            case 'p': parameters.step_time = atof(optarg); break;
+            case 'm': parameters.max_step_rate = atof(optarg); break;
+            case 'M':
+                for (driver = 0; driver < sizeof(driver_names)/sizeof(driver_names[0]); driver++) {
+                    if (strcmp(optarg, driver_names[driver]) == 0)
+                        break;
+                }
+                if (driver == sizeof(driver_names)/sizeof(driver_names[0])) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'b': settle_band = atof(optarg); break;
+            case 'o':
+                trace = fopen(optarg, "w");
+                if (!trace) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'u':
+                uart = fopen(optarg, "wb");
+                if (!uart) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (cuts == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    plasm_on_cycle = SECONDS_TO_CYCLES(plasm_on_time);
+    plasm_off_cycle = NEVER;
+    end_cycle = NEVER;
+
+    // pull-ups: no signals are active
+    PINB = 0xFF;
+    plant_init(&plant, &parameters, 0);
+
+    return firmware_main();
+}
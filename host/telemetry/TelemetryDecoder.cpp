@@ -0,0 +1,344 @@
+/*
+ *  Decoder of the telemetry stream (see lib/Telemetry/Telemetry.h for the frame
+ *  format). Reads a capture file or the serial port itself and writes one row
+ *  per raw arc voltage sample, along with the values of its frame:
+ *    - CSV;
+ *    - and/or columns: a directory with one little-endian binary file per
+ *      column (e.g. numpy.fromfile("raw.u16", "<u2")) and schema.txt.
+ *  Broken frames are skipped by looking for the next sync bytes. Sequence
+ *  numbers show the frames lost on the way or dropped by the firmware
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+// must match Telemetry.h
+#define SYNC1 0xA5
+#define SYNC2 0x5A
+#define HEADER_SIZE 4
+#define PAYLOAD_FIXED_SIZE 14
+#define MAX_FRAME_SIZE (HEADER_SIZE + 255 + 2)
+
+
+typedef struct {
+    uint32_t frame;  // sequence number unwrapped
+    uint8_t state;
+    uint16_t dropped;
+    uint16_t feedback;
+    uint16_t setpoint;
+    int32_t position;
+    int16_t command;
+} FrameValues;
+
+
+/*
+ *  Columnar output
+ */
+typedef struct {
+    const char *name;
+    const char *type;
+    uint8_t size;
+    FILE *file;
+} Column;
+
+enum {FRAME_COLUMN, SAMPLE_COLUMN, STATE_COLUMN, RAW_COLUMN, FEEDBACK_COLUMN,
+      SETPOINT_COLUMN, POSITION_COLUMN, COMMAND_COLUMN, DROPPED_COLUMN, NUM_OF_COLUMNS};
+static Column columns[NUM_OF_COLUMNS] = {
+    {"frame", "u32", 4, NULL},
+    {"sample", "u8", 1, NULL},
+    {"state", "u8", 1, NULL},
+    {"raw", "u16", 2, NULL},
+    {"feedback", "u16", 2, NULL},
+    {"setpoint", "u16", 2, NULL},
+    {"position", "i32", 4, NULL},
+    {"command", "i16", 2, NULL},
+    {"dropped", "u16", 2, NULL},
+};
+static const char *columns_dir = NULL;
+static FILE *csv = NULL;
+static uint64_t rows = 0;
+
+/*
+ *  Statistics
+ */
+static uint64_t frames = 0, crc_errors = 0, skipped_bytes = 0, lost_frames = 0;
+static uint16_t firmware_dropped = 0;
+
+
+static uint16_t crc_xmodem_update(uint16_t crc, uint8_t data) {
+    crc ^= (uint16_t)data<<8;
+    for (uint8_t i = 0; i < 8; i++)
+        crc = crc & 0x8000 ? (crc<<1) ^ 0x1021 : crc<<1;
+    return crc;
+}
+
+
+static uint16_t get16(const uint8_t *p) {
+    return p[0] | (uint16_t)p[1]<<8;
+}
+
+
+static void put_column(uint8_t column, uint32_t value) {
+    uint8_t bytes[4] = {(uint8_t)value, (uint8_t)(value>>8), (uint8_t)(value>>16), (uint8_t)(value>>24)};
+    fwrite(bytes, columns[column].size, 1, columns[column].file);
+}
+
+
+static void write_row(const FrameValues *values, int sample_index, int raw) {
+    rows++;
+    if (csv)
+        fprintf(csv, "%u,%d,%u,%d,%u,%u,%d,%d,%u\n", values->frame, sample_index, values->state,
+                raw, values->feedback, values->setpoint, values->position, values->command,
+                values->dropped);
+    if (columns_dir) {
+        put_column(FRAME_COLUMN, values->frame);
+        put_column(SAMPLE_COLUMN, sample_index);
+        put_column(STATE_COLUMN, values->state);
+        put_column(RAW_COLUMN, raw);
+        put_column(FEEDBACK_COLUMN, values->feedback);
+        put_column(SETPOINT_COLUMN, values->setpoint);
+        put_column(POSITION_COLUMN, values->position);
+        put_column(COMMAND_COLUMN, values->command);
+        put_column(DROPPED_COLUMN, values->dropped);
+    }
+}
+
+
+// frame with the right CRC
+static void decode_frame(const uint8_t *frame) {
+    static bool first = true;
+    static uint32_t frame_number = 0;
+    static uint8_t last_sequence;
+
+    uint8_t length = frame[2];
+    uint8_t sequence = frame[3];
+    const uint8_t *payload = &frame[HEADER_SIZE];
+    uint8_t samples_num = payload[1];
+    if (length != PAYLOAD_FIXED_SIZE + 2*samples_num) {
+        crc_errors++;
+        return;
+    }
+
+    if (!first) {
+        uint8_t gap = sequence - last_sequence - 1;
+        lost_frames += gap;
+        frame_number += gap + 1;
+    }
+    first = false;
+    last_sequence = sequence;
+    frames++;
+
+    FrameValues values;
+    values.frame = frame_number;
+    values.state = payload[0];
+    values.dropped = get16(&payload[2]);
+    values.feedback = get16(&payload[4]);
+    values.setpoint = get16(&payload[6]);
+    values.position = (int32_t)( get16(&payload[8]) | (uint32_t)get16(&payload[10])<<16 );
+    values.command = (int16_t)get16(&payload[12]);
+    firmware_dropped = values.dropped;
+
+    if (!samples_num)
+        write_row(&values, -1, -1);
+    for (uint8_t i = 0; i < samples_num; i++)
+        write_row(&values, i, get16(&payload[PAYLOAD_FIXED_SIZE + 2*i]));
+}
+
+
+/*
+ *  Stream parser: buffer holds the bytes from a (probable) sync on
+ */
+static uint8_t buffer[MAX_FRAME_SIZE];
+static uint16_t buffered = 0;
+
+
+static void drop_bytes(uint16_t n) {
+    memmove(buffer, buffer+n, buffered-n);
+    buffered -= n;
+}
+
+
+static void parse(void) {
+    while (buffered) {
+        // resynchronize
+        if (buffer[0] != SYNC1 || (buffered > 1 && buffer[1] != SYNC2)) {
+            skipped_bytes++;
+            drop_bytes(1);
+            continue;
+        }
+        if (buffered < HEADER_SIZE)
+            return;
+        uint16_t size = HEADER_SIZE + buffer[2] + 2;
+        if (buffered < size)
+            return;
+
+        uint16_t crc = 0;
+        for (uint16_t i = 2; i < size-2; i++)
+            crc = crc_xmodem_update(crc, buffer[i]);
+        if (crc == get16(&buffer[size-2])) {
+            decode_frame(buffer);
+            drop_bytes(size);
+        }
+        else {
+            // false sync or broken frame: look for the next sync inside it
+            crc_errors++;
+            skipped_bytes++;
+            drop_bytes(1);
+        }
+    }
+}
+
+
+static void feed(const uint8_t *data, size_t length) {
+    while (length) {
+        size_t n = sizeof(buffer) - buffered;
+        if (n > length)
+            n = length;
+        memcpy(buffer+buffered, data, n);
+        buffered += n;
+        data += n;
+        length -= n;
+        parse();
+    }
+}
+
+
+static int open_input(const char *path, long baud) {
+    int fd = open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0 || !isatty(fd))
+        return fd;
+
+    // serial port: raw 8N1
+    struct termios tty;
+    tcgetattr(fd, &tty);
+    cfmakeraw(&tty);
+    tty.c_cc[VMIN] = 1;
+    tty.c_cc[VTIME] = 0;
+    speed_t speed;
+    switch (baud) {
+        case 115200: speed = B115200; break;
+        case 230400: speed = B230400; break;
+        case 500000: speed = B500000; break;
+        case 1000000: speed = B1000000; break;
+        case 2000000: speed = B2000000; break;
+        default:
+            fprintf(stderr, "unsupported baud rate %ld\n", baud);
+            close(fd);
+            return -1;
+    }
+    cfsetispeed(&tty, speed);
+    tcsetattr(fd, TCSANOW, &tty);
+    return fd;
+}
+
+
+static bool open_columns(void) {
+    if (mkdir(columns_dir, 0777) != 0 && errno != EEXIST) {
+        perror(columns_dir);
+        return false;
+    }
+    for (uint8_t i = 0; i < NUM_OF_COLUMNS; i++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.%s", columns_dir, columns[i].name, columns[i].type);
+        columns[i].file = fopen(path, "wb");
+        if (!columns[i].file) {
+            perror(path);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+static void close_columns(void) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/schema.txt", columns_dir);
+    FILE *schema = fopen(path, "w");
+    for (uint8_t i = 0; i < NUM_OF_COLUMNS; i++) {
+        fclose(columns[i].file);
+        if (schema)
+            fprintf(schema, "%s %s %llu\n", columns[i].name, columns[i].type, (unsigned long long)rows);
+    }
+    if (schema)
+        fclose(schema);
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options] capture-file|serial-port\n"
+           "  --csv FILE      write CSV (- for stdout)\n"
+           "  --columns DIR   write one binary file per column\n"
+           "  --baud N        serial port baud rate (1000000)\n"
+           "Rows are: frame,sample,state,raw,feedback,setpoint,position,command,dropped\n",
+           name);
+}
+
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"csv", required_argument, NULL, 'c'},
+        {"columns", required_argument, NULL, 'd'},
+        {"baud", required_argument, NULL, 'b'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *csv_file = NULL;
+    long baud = 1000000;
+
+    int option;
+    while ( (option = getopt_long(argc, argv, "", options, NULL)) != -1 ) {
+        switch (option) {
+            case 'c': csv_file = optarg; break;
+            case 'd': columns_dir = optarg; break;
+            case 'b': baud = atol(optarg); break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc-1 || (!csv_file && !columns_dir)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open_input(argv[optind], baud);
+    if (fd < 0) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (csv_file) {
+        csv = strcmp(csv_file, "-") == 0 ? stdout : fopen(csv_file, "w");
+        if (!csv) {
+            perror(csv_file);
+            return 1;
+        }
+        fprintf(csv, "frame,sample,state,raw,feedback,setpoint,position,command,dropped\n");
+    }
+    if (columns_dir && !open_columns())
+        return 1;
+
+    // till the end of the file (or Ctrl-D/hang-up of the port)
+    uint8_t data[4096];
+    ssize_t n;
+    while ( (n = read(fd, data, sizeof(data))) > 0 )
+        feed(data, n);
+    close(fd);
+
+    if (csv && csv != stdout)
+        fclose(csv);
+    if (columns_dir)
+        close_columns();
+    fprintf(stderr, "%llu frames, %llu rows, %llu lost, %u dropped by the firmware, "
+            "%llu CRC errors, %llu bytes skipped\n",
+            (unsigned long long)frames, (unsigned long long)rows, (unsigned long long)lost_frames,
+            firmware_dropped, (unsigned long long)crc_errors, (unsigned long long)skipped_bytes);
+    return 0;
+}
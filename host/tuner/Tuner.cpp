@@ -0,0 +1,686 @@
+/*
+ *  Parameter sweep of the control algorithm. Every combination of the given
+ *  values of the setpoint offset, control rate and setpoint definition timings
+ *  (and PID gains in PID_REGULATION builds) is run in a closed loop against the
+ *  torch/plate model of the simulator (host/sim/Plant.h) with a simple motor
+ *  model (StepPlanner's start speed and acceleration). Arc noise can be taken
+ *  from a recorded trace instead of the model. Configurations are ranked by the
+ *  height error RMS plus the penalty for the motor reversals.
+ *
+ *  The control algorithm (lib/Regulator) keeps its state in globals, as on the
+ *  target, so the evaluations run in worker processes. Each worker has its own
+ *  range of configurations in the shared memory and steals a half of the
+ *  largest remaining range when its own one is done.
+ *
+ *  The winning setpoint offset (and gains) can be written into the EEPROM image
+ *  of a firmware build (.eep, Intel HEX) as the defaults of one of the settings
+ *  profiles, the rest of them is intact.
+ *  Control rate and setpoint definition timings are compile-time settings of
+ *  Regulator.h, they are printed
+ */
+#include <Regulator.h>
+#include <Settings.h>
+#include <ADC.h>
+#include <Motor.h>
+#include <StepPlanner.h>
+#include "Plant.h"
+#include <atomic>
+#include <elf.h>
+#include <getopt.h>
+#include <math.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+
+// EEPROM section of AVR ELF is mapped at this address
+#define AVR_EEPROM_OFFSET 0x810000
+
+
+/*
+ *  Search space
+ */
+typedef struct {
+    uint16_t setpoint_offset;  // 10-bit ADC units
+    uint16_t control_rate;  // Hz
+    uint16_t setpoint_min_time;  // ms
+    uint16_t setpoint_max_time;  // ms
+    uint16_t setpoint_tolerance;
+#ifdef PID_REGULATION
+    uint16_t kp;
+    uint16_t ki;
+    uint16_t kd;
+#endif
+} Config;
+
+typedef struct {
+    double rms;  // mm
+    double max;  // mm
+    double reversals;  // per second
+    double score;
+    bool defined;  // setpoint was defined in all runs
+} Result;
+
+static std::vector<int> offsets, rates, setpoint_min_times, setpoint_max_times, tolerances;
+#ifdef PID_REGULATION
+static std::vector<int> kps, kis, kds;
+#endif
+static std::vector<Config> configs;
+
+/*
+ *  Evaluation
+ */
+static PlantParameters parameters;
+static double cut_time = 20.0;  // s
+static double cutting_height = 1.5;  // mm
+static uint8_t seeds = 3;
+static double reversal_weight = 0.05;  // mm per reversal per second
+static std::vector<int16_t> noise_trace;  // residuals, ADC units
+
+/*
+ *  Work-stealing pool: range of each worker is packed as end<<32 | next
+ */
+struct WorkerRange {
+    std::atomic<uint64_t> range;
+    char padding[64-sizeof(std::atomic<uint64_t>)];  // own cache line
+};
+static WorkerRange *ranges;
+static Result *results;
+static uint16_t workers;
+
+
+static bool parse_values(const char *text, std::vector<int> *values) {
+    values->clear();
+    int from, to, step;
+    if (sscanf(text, "%d:%d:%d", &from, &to, &step) == 3 && step > 0) {
+        for (int value = from; value <= to; value += step)
+            values->push_back(value);
+        return !values->empty();
+    }
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long value = strtol(p, &end, 0);
+        if (end == p)
+            return false;
+        values->push_back(value);
+        p = *end == ',' ? end+1 : end;
+    }
+    return !values->empty();
+}
+
+
+static void build_configs(void) {
+    Config config;
+    memset(&config, 0, sizeof(config));
+    for (int offset : offsets)
+    for (int rate : rates)
+    for (int min_time : setpoint_min_times)
+    for (int max_time : setpoint_max_times)
+    for (int tolerance : tolerances)
+#ifdef PID_REGULATION
+    for (int kp : kps)
+    for (int ki : kis)
+    for (int kd : kds)
+#endif
+    {
+        config.setpoint_offset = offset;
+        config.control_rate = rate;
+        config.setpoint_min_time = min_time;
+        config.setpoint_max_time = max_time;
+        config.setpoint_tolerance = tolerance;
+    #ifdef PID_REGULATION
+        config.kp = kp;
+        config.ki = ki;
+        config.kd = kd;
+    #endif
+        configs.push_back(config);
+    }
+}
+
+
+/*
+ *  Motor: starts and stops at PLANNER_START_SPEED instantly, accelerates with
+ *  PLANNER_ACCELERATION. Stop command (0) of the default mode is immediate
+ */
+static double motor_update(double speed, int16_t command, double dt) {
+#ifndef PID_REGULATION
+    if (command == 0)
+        return 0;
+#endif
+    if (speed == 0 && command != 0)
+        speed = command > 0 ? PLANNER_START_SPEED : -PLANNER_START_SPEED;
+    if (fabs(speed) <= PLANNER_START_SPEED && command == 0)
+        return 0;
+
+    double change = PLANNER_ACCELERATION*dt;
+    if (command > speed)
+        speed = speed+change < command ? speed+change : command;
+    else if (command < speed)
+        speed = speed-change > command ? speed-change : command;
+
+    // reversal goes through the stop
+    if ( fabs(speed) < PLANNER_START_SPEED && command != 0 && (speed > 0) != (command > 0) )
+        speed = 0;
+    return speed;
+}
+
+
+static void evaluate_run(const Config *config, uint64_t seed, double *error_sum_sq, uint64_t *error_cnt,
+                         double *error_max, uint32_t *reversals, bool *defined) {
+    PlantParameters run_parameters = parameters;
+    run_parameters.seed = seed;
+    run_parameters.start_height = cutting_height;
+    Plant plant;
+    plant_init(&plant, &run_parameters, 0);
+
+    RegulatorSettings settings;
+    memset(&settings, 0, sizeof(settings));
+    settings.setpoint_offset = config->setpoint_offset;
+#ifdef PID_REGULATION
+    settings.speed = MOTOR_MAX_SPEED;
+    settings.kp = config->kp;
+    settings.ki = config->ki;
+    settings.kd = config->kd;
+#else
+    settings.speed = MOTOR_SPEED;
+#endif
+    settings.setpoint_min_ticks = (uint32_t)config->setpoint_min_time*config->control_rate/1000;
+    settings.setpoint_max_ticks = (uint32_t)config->setpoint_max_time*config->control_rate/1000;
+    settings.setpoint_tolerance = config->setpoint_tolerance;
+    regulator_start(&settings);
+
+    const double dt = 1.0/ADC_FEEDBACK_RATE;
+    uint64_t samples = cut_time*ADC_FEEDBACK_RATE;
+    size_t trace_position = noise_trace.empty() ? 0 : seed*7919 % noise_trace.size();
+    double speed = 0, position = 0;
+    int16_t command = 0, last_direction = 0;
+    uint64_t tick = 0;
+    *defined = false;
+
+    for (uint64_t i = 0; i < samples; i++) {
+        double time = i*dt;
+        plant_advance(&plant, &run_parameters, time);
+
+        int32_t value = plant_feedback_adc(&plant, &run_parameters, true);
+        if (!noise_trace.empty()) {
+            value += noise_trace[trace_position];
+            if (++trace_position == noise_trace.size())
+                trace_position = 0;
+            value = value < 0 ? 0 : value > 1023 ? 1023 : value;
+        }
+    #ifdef ANTI_DIVE
+        // height lock stops the motor right away
+        if (regulator_watch(value))
+            speed = 0;
+    #endif
+        regulator_sample(value);
+
+        // control tick after as many samples as the ADC gives at the tested rate
+        if ( (i+1)*config->control_rate/ADC_FEEDBACK_RATE > tick ) {
+            tick++;
+            if (regulator_tick(&command) != REGULATOR_DEFINING_SETPOINT)
+                *defined = true;
+        }
+
+        speed = motor_update(speed, *defined ? command : 0, dt);
+        position += speed*dt;
+        plant_step(&plant, &run_parameters, lround(position));
+
+        if (*defined) {
+            double error = plant_height(&plant, &run_parameters) - cutting_height;
+            *error_sum_sq += error*error;
+            (*error_cnt)++;
+            if (fabs(error) > *error_max)
+                *error_max = fabs(error);
+
+            int16_t direction = speed > 0 ? 1 : speed < 0 ? -1 : 0;
+            if (direction) {
+                if (last_direction && direction != last_direction)
+                    (*reversals)++;
+                last_direction = direction;
+            }
+        }
+    }
+}
+
+
+static void evaluate(uint32_t index) {
+    double error_sum_sq = 0, error_max = 0;
+    uint64_t error_cnt = 0;
+    uint32_t reversals = 0;
+    bool all_defined = true;
+
+    for (uint8_t seed = 1; seed <= seeds; seed++) {
+        bool defined;
+        evaluate_run(&configs[index], parameters.seed*1000 + seed, &error_sum_sq, &error_cnt,
+                     &error_max, &reversals, &defined);
+        all_defined = all_defined && defined;
+    }
+
+    Result *result = &results[index];
+    result->defined = all_defined && error_cnt;
+    result->rms = error_cnt ? sqrt(error_sum_sq/error_cnt) : INFINITY;
+    result->max = error_max;
+    result->reversals = reversals/(cut_time*seeds);
+    result->score = result->defined ? result->rms + reversal_weight*result->reversals : INFINITY;
+}
+
+
+static inline uint64_t pack_range(uint32_t next, uint32_t end) {
+    return (uint64_t)end<<32 | next;
+}
+
+
+static bool take_job(WorkerRange *worker, uint32_t *job) {
+    uint64_t range = worker->range.load();
+    for (;;) {
+        uint32_t next = range, end = range>>32;
+        if (next >= end)
+            return false;
+        if (worker->range.compare_exchange_weak(range, pack_range(next+1, end))) {
+            *job = next;
+            return true;
+        }
+    }
+}
+
+
+// Take the upper half of the largest remaining range
+static bool steal_jobs(uint16_t self) {
+    for (;;) {
+        uint16_t victim = self;
+        uint32_t most = 0;
+        for (uint16_t i = 0; i < workers; i++) {
+            uint64_t range = ranges[i].range.load();
+            uint32_t left = (uint32_t)(range>>32) - (uint32_t)range;
+            if ((uint32_t)range < (uint32_t)(range>>32) && left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim == self)
+            return false;
+
+        uint64_t range = ranges[victim].range.load();
+        uint32_t next = range, end = range>>32;
+        if (next >= end)
+            continue;
+        uint32_t middle = next + (end-next)/2;
+        if (ranges[victim].range.compare_exchange_strong(range, pack_range(next, middle))) {
+            ranges[self].range.store(pack_range(middle, end));
+            return true;
+        }
+    }
+}
+
+
+static void worker(uint16_t self) {
+    uint32_t job;
+    do {
+        while (take_job(&ranges[self], &job))
+            evaluate(job);
+    } while (steal_jobs(self));
+}
+
+
+static bool run_pool(void) {
+    uint32_t count = configs.size();
+    ranges = (WorkerRange *)mmap(NULL, workers*sizeof(WorkerRange), PROT_READ|PROT_WRITE,
+                                 MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    results = (Result *)mmap(NULL, count*sizeof(Result), PROT_READ|PROT_WRITE,
+                             MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (ranges == MAP_FAILED || results == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    for (uint16_t i = 0; i < workers; i++) {
+        new (&ranges[i].range) std::atomic<uint64_t>(pack_range((uint64_t)count*i/workers,
+                                                                (uint64_t)count*(i+1)/workers));
+    }
+
+    std::vector<pid_t> children;
+    for (uint16_t i = 0; i < workers; i++) {
+        pid_t child = fork();
+        if (child == 0) {
+            worker(i);
+            _exit(0);
+        }
+        if (child < 0) {
+            perror("fork");
+            return false;
+        }
+        children.push_back(child);
+    }
+    bool ok = true;
+    for (pid_t child : children) {
+        int status;
+        waitpid(child, &status, 0);
+        ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    return ok;
+}
+
+
+/*
+ *  Recorded arc noise: samples minus their mean
+ */
+static bool load_noise_trace(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return false;
+    }
+    std::vector<uint16_t> samples;
+    uint8_t bytes[2];
+    while (fread(bytes, 2, 1, file) == 1) {
+        uint16_t sample = bytes[0] | bytes[1]<<8;
+        if (sample <= 1023)
+            samples.push_back(sample);
+    }
+    fclose(file);
+    if (samples.empty()) {
+        fprintf(stderr, "%s: no samples\n", path);
+        return false;
+    }
+
+    double mean = 0;
+    for (uint16_t sample : samples)
+        mean += sample;
+    mean /= samples.size();
+    for (uint16_t sample : samples)
+        noise_trace.push_back(lround(sample-mean));
+    return true;
+}
+
+
+/*
+ *  EEPROM image: .eeprom section of the firmware ELF with the winning values
+ *  written over the defaults of the given profile
+ */
+static bool write_eep(const char *elf_path, const char *eep_path, uint8_t profile, const Config *config) {
+    FILE *file = fopen(elf_path, "rb");
+    if (!file) {
+        perror(elf_path);
+        return false;
+    }
+    std::vector<uint8_t> elf;
+    uint8_t buffer[4096];
+    size_t n;
+    while ( (n = fread(buffer, 1, sizeof(buffer), file)) > 0 )
+        elf.insert(elf.end(), buffer, buffer+n);
+    fclose(file);
+
+    const Elf32_Ehdr *header = (const Elf32_Ehdr *)elf.data();
+    if ( elf.size() < sizeof(Elf32_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+         header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_machine != EM_AVR ) {
+        fprintf(stderr, "%s is not an AVR ELF\n", elf_path);
+        return false;
+    }
+    const Elf32_Shdr *sections = (const Elf32_Shdr *)&elf[header->e_shoff];
+    const char *section_names = (const char *)&elf[sections[header->e_shstrndx].sh_offset];
+
+    std::vector<uint8_t> eeprom;
+    uint32_t eeprom_address = 0;
+    const Elf32_Shdr *symtab = NULL;
+    for (uint16_t i = 0; i < header->e_shnum; i++) {
+        if (strcmp(section_names + sections[i].sh_name, ".eeprom") == 0) {
+            eeprom.assign(&elf[sections[i].sh_offset], &elf[sections[i].sh_offset] + sections[i].sh_size);
+            eeprom_address = sections[i].sh_addr;
+        }
+        if (sections[i].sh_type == SHT_SYMTAB)
+            symtab = &sections[i];
+    }
+    if (eeprom.empty() || !symtab) {
+        fprintf(stderr, "%s: no EEPROM section or symbols\n", elf_path);
+        return false;
+    }
+
+    // defaults of the settings (see Settings.h), their layout is the same on the host
+    const Elf32_Sym *symbols = (const Elf32_Sym *)&elf[symtab->sh_offset];
+    const char *names = (const char *)&elf[sections[symtab->sh_link].sh_offset];
+    uint32_t defaults = UINT32_MAX;
+    for (uint32_t i = 0; i < symtab->sh_size/sizeof(Elf32_Sym); i++) {
+        if ( strcmp(names + symbols[i].st_name, "settings_defaults") == 0 &&
+             symbols[i].st_size == sizeof(Settings) &&
+             symbols[i].st_value - eeprom_address + sizeof(Settings) <= eeprom.size() )
+            defaults = symbols[i].st_value - eeprom_address;
+    }
+    if (defaults == UINT32_MAX) {
+        fprintf(stderr, "%s: no settings_defaults of %u bytes in EEPROM\n", elf_path, (unsigned)sizeof(Settings));
+        return false;
+    }
+
+    struct {
+        size_t offset;
+        uint16_t value;
+    } values[] = {
+        {offsetof(Profile, setpoint_offset), config->setpoint_offset},
+    #ifdef PID_REGULATION
+        {offsetof(Profile, kp), config->kp},
+        {offsetof(Profile, ki), config->ki},
+        {offsetof(Profile, kd), config->kd},
+    #endif
+    };
+    for (auto &value : values) {
+        uint32_t offset = defaults + offsetof(Settings, profiles) + profile*sizeof(Profile) + value.offset;
+        eeprom[offset] = value.value;
+        eeprom[offset+1] = value.value>>8;
+    }
+
+    // Intel HEX, 16 bytes per record
+    FILE *eep = fopen(eep_path, "w");
+    if (!eep) {
+        perror(eep_path);
+        return false;
+    }
+    uint16_t base = eeprom_address - AVR_EEPROM_OFFSET;
+    for (size_t i = 0; i < eeprom.size(); i += 16) {
+        uint8_t length = eeprom.size()-i < 16 ? eeprom.size()-i : 16;
+        uint16_t address = base + i;
+        uint8_t sum = length + (address>>8) + address;
+        fprintf(eep, ":%02X%04X00", length, address);
+        for (uint8_t j = 0; j < length; j++) {
+            fprintf(eep, "%02X", eeprom[i+j]);
+            sum += eeprom[i+j];
+        }
+        fprintf(eep, "%02X\n", (uint8_t)-sum);
+    }
+    fprintf(eep, ":00000001FF\n");
+    fclose(eep);
+    return true;
+}
+
+
+static void print_config(const Config *config, const Result *result) {
+    printf("%6u %5u %6u %6u %4u ", config->setpoint_offset, config->control_rate,
+           config->setpoint_min_time, config->setpoint_max_time, config->setpoint_tolerance);
+#ifdef PID_REGULATION
+    printf("%5u %5u %5u ", config->kp, config->ki, config->kd);
+#endif
+    if (result->defined)
+        printf("%8.4f %8.4f %9.2f %8.4f\n", result->rms, result->max, result->reversals, result->score);
+    else
+        printf("%8s %8s %9s %8s\n", "-", "-", "-", "no sp");
+}
+
+
+static void usage(const char *name) {
+    printf("Usage: %s [options]\n"
+           "Values are a list (a,b,c) or a range (from:to:step)\n"
+           "  --offset V         setpoint offset, 10-bit ADC units (5:40:5)\n"
+           "  --rate V           control rate, Hz (%d)\n"
+           "  --setpoint-min V   minimal setpoint definition time, ms (%d)\n"
+           "  --setpoint-max V   maximal setpoint definition time, ms (%d)\n"
+           "  --tolerance V      setpoint definition tolerance (%d)\n"
+#ifdef PID_REGULATION
+           "  --kp V --ki V --kd V  PID gains (320, 2, 0)\n"
+#endif
+           "Evaluation:\n"
+           "  --time S           cutting time of each run (%.1f s)\n"
+           "  --seeds N          runs with different random seeds (%u)\n"
+           "  --seed N           base random seed (%llu)\n"
+           "  --height MM        cutting height (%.2f mm)\n"
+           "  --noise V          arc voltage noise, standard deviation (%.2f V)\n"
+           "  --spikes N         arc voltage spikes per second (%.2f)\n"
+           "  --noise-trace FILE take arc noise from uint16 samples (e.g. raw.u16 of the telemetry)\n"
+           "  --warp MM          plate warp amplitude (%.2f mm)\n"
+           "  --step MM          plate step height (%.2f mm)\n"
+           "  --step-time S      time of the plate step (%.1f s)\n"
+           "  --reversal-weight W  mm of RMS error per motor reversal per second (%.3f)\n"
+           "  --jobs N           worker processes (all cores)\n"
+           "Output:\n"
+           "  --top N            print N best configurations (10)\n"
+           "  --elf FILE --eep FILE  EEPROM image of the firmware with the winning values\n"
+           "  --profile N        settings profile they are written to (1-%d, 1)\n",
+           name, CONTROL_RATE, SETPOINT_MIN_TIME, SETPOINT_MAX_TIME, SETPOINT_TOLERANCE,
+           cut_time, seeds, (unsigned long long)parameters.seed, cutting_height, parameters.noise,
+           parameters.spike_rate, parameters.warp_amplitude, parameters.step_height,
+           parameters.step_time, reversal_weight, PROFILES);
+}
+
+
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"offset", required_argument, NULL, 'o'},
+        {"rate", required_argument, NULL, 'r'},
+        {"setpoint-min", required_argument, NULL, 'm'},
+        {"setpoint-max", required_argument, NULL, 'M'},
+        {"tolerance", required_argument, NULL, 't'},
+    #ifdef PID_REGULATION
+        {"kp", required_argument, NULL, 'p'},
+        {"ki", required_argument, NULL, 'i'},
+        {"kd", required_argument, NULL, 'd'},
+    #endif
+        {"time", required_argument, NULL, 'T'},
+        {"seeds", required_argument, NULL, 'S'},
+        {"seed", required_argument, NULL, 's'},
+        {"height", required_argument, NULL, 'H'},
+        {"noise", required_argument, NULL, 'n'},
+        {"spikes", required_argument, NULL, 'k'},
+        {"noise-trace", required_argument, NULL, 'N'},
+        {"warp", required_argument, NULL, 'w'},
+        {"step", required_argument, NULL, 'h'},
+        {"step-time", required_argument, NULL, 'P'},
+        {"reversal-weight", required_argument, NULL, 'W'},
+        {"jobs", required_argument, NULL, 'j'},
+        {"top", required_argument, NULL, 'x'},
+        {"elf", required_argument, NULL, 'e'},
+        {"eep", required_argument, NULL, 'E'},
+        {"profile", required_argument, NULL, 'R'},
+        {"help", no_argument, NULL, '?'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *elf_file = NULL, *eep_file = NULL;
+    int profile = 1;
+    unsigned top = 10;
+
+    plant_defaults(&parameters);
+    parse_values("5:40:5", &offsets);
+    rates.push_back(CONTROL_RATE);
+    setpoint_min_times.push_back(SETPOINT_MIN_TIME);
+    setpoint_max_times.push_back(SETPOINT_MAX_TIME);
+    tolerances.push_back(SETPOINT_TOLERANCE);
+#ifdef PID_REGULATION
+    kps.push_back(320);
+    kis.push_back(2);
+    kds.push_back(0);
+#endif
+    workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int option;
+    bool ok = true;
+    while ( ok && (option = getopt_long(argc, argv, "", options, NULL)) != -1 ) {
+        switch (option) {
+            case 'o': ok = parse_values(optarg, &offsets); break;
+            case 'r': ok = parse_values(optarg, &rates); break;
+            case 'm': ok = parse_values(optarg, &setpoint_min_times); break;
+            case 'M': ok = parse_values(optarg, &setpoint_max_times); break;
+            case 't': ok = parse_values(optarg, &tolerances); break;
+        #ifdef PID_REGULATION
+            case 'p': ok = parse_values(optarg, &kps); break;
+            case 'i': ok = parse_values(optarg, &kis); break;
+            case 'd': ok = parse_values(optarg, &kds); break;
+        #endif
+            case 'T': cut_time = atof(optarg); break;
+            case 'S': seeds = atoi(optarg); break;
+            case 's': parameters.seed = strtoull(optarg, NULL, 0); break;
+            case 'H': cutting_height = atof(optarg); break;
+            case 'n': parameters.noise = atof(optarg); break;
+            case 'k': parameters.spike_rate = atof(optarg); break;
+            case 'N':
+                ok = load_noise_trace(optarg);
+                // recorded noise replaces the modelled one
+                parameters.noise = 0;
+                parameters.spike_rate = 0;
+                break;
+            case 'w': parameters.warp_amplitude = atof(optarg); break;
+            case 'h': parameters.step_height = atof(optarg); break;
+            case 'P': parameters.step_time = atof(optarg); break;
+            case 'W': reversal_weight = atof(optarg); break;
+            case 'j': workers = atoi(optarg); break;
+            case 'x': top = atoi(optarg); break;
+            case 'e': elf_file = optarg; break;
+            case 'E': eep_file = optarg; break;
+            case 'R': profile = atoi(optarg); break;
+            default: ok = false; break;
+        }
+    }
+    if ( !ok || optind != argc || workers == 0 || seeds == 0 || (!elf_file != !eep_file) ||
+         profile < 1 || profile > PROFILES ) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (int rate : rates) {
+        if (rate <= 0 || (unsigned long)rate > ADC_FEEDBACK_RATE) {
+            fprintf(stderr, "control rate must be within 1-%lu Hz\n", (unsigned long)ADC_FEEDBACK_RATE);
+            return 1;
+        }
+    }
+
+    build_configs();
+    if (workers > configs.size())
+        workers = configs.size();
+    fprintf(stderr, "%zu configurations x %u runs of %.1f s on %u workers\n",
+            configs.size(), seeds, cut_time, workers);
+    if (!run_pool())
+        return 1;
+
+    std::vector<uint32_t> order(configs.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [](uint32_t a, uint32_t b) {
+        return results[a].score < results[b].score;
+    });
+
+    printf("%6s %5s %6s %6s %4s ", "offset", "rate", "sp_min", "sp_max", "tol");
+#ifdef PID_REGULATION
+    printf("%5s %5s %5s ", "kp", "ki", "kd");
+#endif
+    printf("%8s %8s %9s %8s\n", "rms_mm", "max_mm", "reversals", "score");
+    for (uint32_t i = 0; i < order.size() && i < top; i++)
+        print_config(&configs[order[i]], &results[order[i]]);
+
+    const Config *best = &configs[order[0]];
+    if (!results[order[0]].defined) {
+        fprintf(stderr, "setpoint was never defined\n");
+        return 1;
+    }
+    if ( best->control_rate != CONTROL_RATE || best->setpoint_min_time != SETPOINT_MIN_TIME ||
+         best->setpoint_max_time != SETPOINT_MAX_TIME || best->setpoint_tolerance != SETPOINT_TOLERANCE )
+        printf("set in Regulator.h: CONTROL_RATE %u, SETPOINT_MIN_TIME %u, SETPOINT_MAX_TIME %u, "
+               "SETPOINT_TOLERANCE %u\n", best->control_rate, best->setpoint_min_time,
+               best->setpoint_max_time, best->setpoint_tolerance);
+    if (elf_file) {
+        if (!write_eep(elf_file, eep_file, profile-1, best))
+            return 1;
+        printf("EEPROM image with the winning values in profile %d: %s\n", profile, eep_file);
+    }
+    return 0;
+}
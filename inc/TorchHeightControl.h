@@ -13,22 +13,44 @@
  *  User libraries
  */
 // We use custom ADC library instead of Arduino's analogRead()
-// because second takes some unwanted for us periphery (timer)
-// and it is actually quite simple to write your own lightweight version
-// of analogRead() so why not?
+// because second takes some unwanted for us periphery (timer) and,
+// more important, waits for the conversion. Ours measures both channels
+// in the background and simply hands ready samples out
 #include <ADC.h>
+// Control algorithm (filtering, setpoint definition and decisions), the same
+// code runs in the host tools
+#include <Regulator.h>
 // Abstraction layer for the way we rule the motor. There can be a driver
 // for a stepper motor plus set of switches, a stepper motor with
 // "intelligent" step-direction driver, simply DC motor or whatever you wants to.
-#include <MotorDriver.h>
+// Drivers are templates over their pins, the one in use is chosen below
+#include <Motor.h>
+#include <StepDirDriver.h>
+#include <PhaseDriver.h>
+// Interrupt handlers only post events, all the logic runs in the main loop
+#include <Scheduler.h>
+// Edges of the control signals are captured with timestamps and debounced on
+// the control timer tick
+#include <Inputs.h>
+// Cutting parameters profiles cached in RAM, EEPROM keeps a wear-leveled journal
+// of them
+#include <Settings.h>
+// Integer conversions of ADC values to voltages and steps to distances
+// and formatting of them for the LCD
+#include <Units.h>
+// Compile-time switchable timing of the interrupt handlers (see Profiler.h)
+#include <Profiler.h>
+// Optional binary stream of the control loop through the UART
+#include <Telemetry.h>
 
 
 /*
  *  Control signals definitions (all of them are inputs)
  *  Free (unused) pins:
- *    - PB5 (can be used as a test LED)
- *    - PD0
- *    - PD1
+ *    - PB5 (can be used as a test LED or the height lock input, taken by LCD when
+ *      HwStepDirDriver is used)
+ *    - PD0 (UART RX)
+ *    - PC4, PC5 (with a STEP/DIR driver; LCD RS goes to PC4 when TELEMETRY is used)
  */
 #define SIGNALS_DDR DDRB
 #define SIGNALS_PIN PINB
@@ -42,19 +64,51 @@
 #define TOUCH_SIGNAL_INT PCINT1
 #define SETTINGS_BUTTON_PIN PB0
 #define SETTINGS_BUTTON_INT PCINT0
+// signals going through the debouncing (the touch is handled right in the ISR)
+#define DEBOUNCED_SIGNALS ( (1<<SETTINGS_BUTTON_PIN) | (1<<UP_SIGNAL_PIN) | \
+                            (1<<DOWN_SIGNAL_PIN) | (1<<PLASM_SIGNAL_PIN) )
+// Uncomment for the height lock input from the CNC (e.g. while slowing down in
+// corners), it needs ANTI_DIVE in Regulator.h
+// #define HEIGHT_LOCK_SIGNAL
+#ifdef HEIGHT_LOCK_SIGNAL
+    #define HEIGHT_LOCK_SIGNAL_PIN PB5
+    #define HEIGHT_LOCK_SIGNAL_INT PCINT5
+#endif
 // initial state: all signals are pulled up to Vcc
 uint8_t signals_port_history = 0xFF;
 
 
+/*
+ *  Z-axis motor driver (see Motor.h), uncomment the one you have:
+ *    - StepDirDriver<DIR, STEP>: "smart" driver, STEP pulses by the ISR;
+ *    - HwStepDirDriver<DIR>: STEP pulses by Timer2 hardware on PD3;
+ *    - PhaseDriver<port, pin of phase A, stepping mode>: 4-wire bipolar stepper
+ *      plus set of switches on 4 pins in a row (A-C-B-D)
+ */
+typedef StepDirDriver< Pin<PortC, PC2>, Pin<PortC, PC3> > ZMotorDriver;
+// typedef HwStepDirDriver< Pin<PortC, PC2> > ZMotorDriver;
+// typedef PhaseDriver<PortC, PC2, MOTOR_WAVE> ZMotorDriver;
+typedef Motor<ZMotorDriver> ZMotor;
+
+
 /*
  *  Menu definitions
  */
 enum Menu {
     WORK_MENU,
     IDLE_MENU,
+    PROFILE_MENU,
     cutting_height_MENU,
     SETPOINT_OFFSET_MENU,
     PIERCE_TIME_MENU,
+#ifdef PID_REGULATION
+    PID_KP_MENU,
+    PID_KI_MENU,
+    PID_KD_MENU,
+#endif
+#ifdef PROFILING
+    DIAGNOSTICS_MENU,
+#endif
 
     NUM_OF_MENUS
 };
@@ -62,15 +116,75 @@ uint8_t menu = IDLE_MENU;  // initial state
 
 
 /*
- *  LCD definitions. We use Arduino's standard library LiquidCrystal for this
- *  because of its robustness and widespread
+ *  States of the cutting cycle (see UML diagram). Settings menus and bypass mode
+ *  are possible only in the Idle state
+ */
+enum State {
+    IDLE_STATE,
+    START_STATE,  // moving down till the touch (see ProbePhase)
+    PIERCE_STATE,  // lifting to the cutting height and waiting for the pierce
+    DEFINE_SP_STATE,
+    WORK_STATE,
+    DIVE_STATE,  // torch has touched the plate while cutting, retracting
+    CALIBRATE_STATE  // measuring the arc voltage per step (SLOPE_CORRECTION)
+};
+volatile uint8_t state = IDLE_STATE;
+
+// Touch-off steps of the Start state
+enum ProbePhase {
+    APPROACH_PHASE,  // fast down till the clearance above the last touch height
+    PROBE_PHASE,  // down till the touch
+    BACKOFF_PHASE,  // up a bit after the touch to touch once more
+    RETOUCH_PHASE  // down at the lowest speed till the touch
+};
+
+
+/*
+ *  Events processed by the main loop
+ */
+enum Event {
+    BUTTON_EVENT = NO_EVENT+1,  // settings button has changed (debounced, see Inputs.h)
+    BYPASS_HOLD_EVENT,  // settings button is held long enough to toggle bypass mode
+    UP_EVENT,  // up signal has changed (debounced)
+    DOWN_EVENT,  // down signal has changed (debounced)
+    PLASM_EVENT,  // plasm signal has changed (debounced)
+    PROBE_MOVED_EVENT,  // fast approach or back-off is over
+    TOUCH_EVENT,  // torch has touched the metal (motor is already stopped)
+    DIVE_EVENT,  // the same while cutting (motor is already retracting)
+    LIFTED_EVENT,  // torch has reached the cutting height
+    PIERCE_DONE_EVENT,
+    SETPOINT_DEFINED_EVENT,
+    LCD_REFRESH_EVENT
+};
+
+/*
+ *  Software timers. They are counted in ticks of control algorithm timer (Timer0)
  */
-#include <LiquidCrystal.h>
-// RS, RW (optional, faster in general), E, D4-7
-LiquidCrystal lcd(1, 2, 3, 4, 5, 6, 7);
-// we need slightly more than the length of a string (16 in our case)
-// due to the inner structure of the sprintf(). Otherwise, displayed
-// values can be corrupted
+enum Timer {
+    BYPASS_TIMER,
+    PIERCE_TIMER,
+    LCD_TIMER,
+
+    NUM_OF_TIMERS
+};
+
+
+/*
+ *  LCD definitions. Our own buffered driver is used so the display never stalls
+ *  the main loop (see LCD.h for the pinout)
+ */
+#include <LCD.h>
+#ifndef LCD_E_ON_PB5
+    static_assert(!ZMotorDriver::uses_oc2b, "PD3 (OC2B) is occupied by STEP signal, define LCD_E_ON_PB5 in LCD.h");
+#endif
+#ifdef LCD_RS_ON_PC4
+    static_assert(!(ZMotorDriver::portc_pins & (1<<PC4)), "PC4 is written by the motor driver, LCD RS can't be moved there");
+#endif
+#if defined(TELEMETRY) && !defined(LCD_RS_ON_PC4)
+    #error "PD1 (TXD) is occupied by telemetry, define LCD_RS_ON_PC4 in LCD.h"
+#endif
+// slightly more than the length of a row (16 in our case) in case
+// a formatted value is longer than expected (it is cut by lcd_print())
 #define BUFFER_SIZE 25
 char bufferA[BUFFER_SIZE];  // 1st raw of LCD
 char bufferB[BUFFER_SIZE];  // 2nd raw of LCD
@@ -87,5 +201,19 @@ char bufferB[BUFFER_SIZE];  // 2nd raw of LCD
 #endif
 
 
+/*
+ *  Anti-dive (see Regulator.h) watches the samples right from the ADC interrupt
+ */
+#if defined(ANTI_DIVE) && !defined(ADC_FEEDBACK_HOOK)
+    #error "ANTI_DIVE needs ADC_FEEDBACK_HOOK in ADC.h"
+#endif
+#if defined(HEIGHT_LOCK_SIGNAL) && !defined(ANTI_DIVE)
+    #error "HEIGHT_LOCK_SIGNAL needs ANTI_DIVE in Regulator.h"
+#endif
+#if defined(HEIGHT_LOCK_SIGNAL) && (defined(LCD_E_ON_PB5) || defined(TEST_LED))
+    #error "PB5 is occupied by LCD E or the test LED, the height lock input can't be used"
+#endif
+
+
 
 #endif /* TORCHHEIGHTCONTROL_H_ */
@@ -1,27 +1,110 @@
 #include <ADC.h>
 
 
+#if ADC_PRESCALER == 128
+    #define ADC_PRESCALER_BITS ((1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0))
+#elif ADC_PRESCALER == 64
+    #define ADC_PRESCALER_BITS ((1<<ADPS2)|(1<<ADPS1))
+#elif ADC_PRESCALER == 32
+    #define ADC_PRESCALER_BITS ((1<<ADPS2)|(1<<ADPS0))
+#else
+    #error "ADC_PRESCALER must be 32, 64 or 128"
+#endif
+#if F_CPU/ADC_PRESCALER > 200000
+    #warning "ADC clock is above 200kHz, expect less than 10 bits of resolution"
+#endif
+
+#define ADC_BUFFER_MASK (ADC_BUFFER_SIZE-1)
+#if (ADC_BUFFER_SIZE & ADC_BUFFER_MASK) || (ADC_BUFFER_SIZE > 128)
+    #error "ADC_BUFFER_SIZE must be a power of 2 not greater than 128"
+#endif
+
+// Single producer (ADC_vect) - single consumer ring buffer. Head is written only
+// by the ISR and tail only by the consumer so 8-bit (atomic) indexes are enough
+static volatile uint16_t feedback_buffer[ADC_BUFFER_SIZE];
+static volatile uint8_t feedback_head = 0;
+static volatile uint8_t feedback_tail = 0;
+
+static volatile uint16_t settings_value = 0;
+
+// channel the currently running conversion was started for
+static uint8_t current_channel = ADC_FEEDBACK_PIN;
+static uint8_t slot_cnt = 0;
+
+
 void adc_init(void) {
-    // enable ADC, prescaler=128
-    ADCSRA |= (1<<ADEN) | (1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0);
-    // AVCC with external capacitor at AREF pin
-    ADMUX |= (1<<REFS0);
+    // AVCC with external capacitor at AREF pin, feedback channel first
+    ADMUX = (1<<REFS0) | ADC_FEEDBACK_PIN;
+    // enable ADC and its interrupt, set prescaler and start the first conversion.
+    // Actual processing begins as soon as interrupts are globally enabled
+    ADCSRA = (1<<ADEN) | (1<<ADIE) | ADC_PRESCALER_BITS | (1<<ADSC);
 }
 
 
-uint16_t adc_read(uint8_t adc_channel) {
-    // reset current channel
-    ADMUX &= 0xF0;
-    // set new channel
-    ADMUX |= adc_channel;
+/*
+ *  Conversion complete. We start every next conversion right from here (instead of
+ *  ADC's own free-running mode) so the channel of each result is always known
+ *  exactly, even if this ISR has been delayed by another one
+ */
+ISR (ADC_vect) {
+    PROFILE_ISR_BEGIN(PROFILE_ADC_ISR);
+
+    uint16_t result = ADC;
+
+    if (current_channel == ADC_FEEDBACK_PIN) {
+        #ifdef ADC_FEEDBACK_HOOK
+            adc_feedback_hook(result);
+        #endif
+        // drop the newest sample if the consumer is too slow
+        if ((uint8_t)(feedback_head-feedback_tail) < ADC_BUFFER_SIZE) {
+            feedback_buffer[feedback_head & ADC_BUFFER_MASK] = result;
+            feedback_head++;
+        }
+    }
+    else {
+        settings_value = result;
+    }
 
-    // start conversion
+    // choose the channel for the next conversion and start it
+    if (++slot_cnt == ADC_SETTINGS_SLOT) {
+        slot_cnt = 0;
+        current_channel = ADC_SETTINGS_PIN;
+    }
+    else {
+        current_channel = ADC_FEEDBACK_PIN;
+    }
+    ADMUX = (ADMUX & 0xF0) | current_channel;
     ADCSRA |= (1<<ADSC);
-    // wait for completing
-    while ( !(ADCSRA & (1<<ADIF)) ) {}
-    // clear interrupt flag
-    ADCSRA |= (1<<ADIF);
 
-    // register containing result
-    return ADC;
+    PROFILE_ISR_END(PROFILE_ADC_ISR);
+}
+
+
+uint8_t adc_feedback_available(void) {
+    return feedback_head - feedback_tail;
+}
+
+
+// Take the oldest sample. Call only when adc_feedback_available() is non-zero
+uint16_t adc_feedback_get(void) {
+    uint16_t sample = feedback_buffer[feedback_tail & ADC_BUFFER_MASK];
+    feedback_tail++;
+    return sample;
+}
+
+
+// Forget all the accumulated samples (e.g. stale ones gathered while idle)
+void adc_feedback_flush(void) {
+    feedback_tail = feedback_head;
+}
+
+
+uint16_t adc_settings_value(void) {
+    uint16_t value;
+    // 16-bit variable shared with the ISR
+    uint8_t sreg = SREG;
+    cli();
+    value = settings_value;
+    SREG = sreg;
+    return value;
 }
@@ -4,17 +4,57 @@
 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include <Profiler.h>
 
 // ADC pinout
 #define ADC_SETTINGS_PIN 0  // PC0
 #define ADC_FEEDBACK_PIN 1  // PC1
 
 // edit this value to match your voltage
-#define ADC_REFERENCE_VOLTAGE 5.00
+#define ADC_REFERENCE_MILLIVOLTS 5000
+
+/*
+ *  Conversions run continuously in the background: ADC_vect takes the result and
+ *  immediately starts the next conversion so nobody ever waits for the ADC.
+ *  Prescaler sets the sampling rate: 128 gives 125kHz ADC clock, i.e. ~9600
+ *  conversions per second (13 ADC clocks each) shared between the channels.
+ *  64 and 32 double and quadruple it at the cost of the resolution (datasheet
+ *  guarantees full 10 bits only up to 200kHz ADC clock)
+ */
+#define ADC_PRESCALER 128
+#define ADC_CONVERSION_CLOCKS 13
+#define ADC_SAMPLE_RATE (F_CPU/ADC_PRESCALER/ADC_CONVERSION_CLOCKS)
+// each ADC_SETTINGS_SLOT-th conversion is given to the settings potentiometer,
+// all the others are arc feedback samples
+#define ADC_SETTINGS_SLOT 16
+#define ADC_FEEDBACK_RATE (ADC_SAMPLE_RATE-ADC_SAMPLE_RATE/ADC_SETTINGS_SLOT)
+// Ring buffer for the feedback samples. Must be a power of 2 and not greater
+// than 128 (free-running 8-bit indexes are used)
+#define ADC_BUFFER_SIZE 64
+
+/*
+ *  Uncomment to hand every feedback sample to adc_feedback_hook() right from the
+ *  conversion interrupt before it's buffered (the application defines it, keep
+ *  it short): reaction within one sample instead of one control tick
+ */
+// #define ADC_FEEDBACK_HOOK
 
 
 void adc_init(void);
-uint16_t adc_read(uint8_t adc_channel);
+
+// Feedback samples consumer interface. There is only one consumer (control
+// algorithm) so no locking is needed
+uint8_t adc_feedback_available(void);
+uint16_t adc_feedback_get(void);
+void adc_feedback_flush(void);
+
+// last measured value of the settings potentiometer
+uint16_t adc_settings_value(void);
+
+#ifdef ADC_FEEDBACK_HOOK
+void adc_feedback_hook(uint16_t sample);
+#endif
 
 
 
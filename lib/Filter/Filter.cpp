@@ -0,0 +1,149 @@
+#include <Filter.h>
+
+
+#if FILTER_TYPE == FILTER_MOVING_AVERAGE
+
+#if (FILTER_WINDOW & (FILTER_WINDOW-1)) || (FILTER_WINDOW > 128) || (FILTER_WINDOW < (1<<FILTER_EXTRA_BITS))
+    #error "FILTER_WINDOW must be a power of 2 between 2^FILTER_EXTRA_BITS and 128"
+#endif
+
+static uint16_t window[FILTER_WINDOW];
+static uint8_t window_idx = 0;
+static uint32_t window_sum = 0;
+
+
+void filter_reset(uint16_t value) {
+    uint16_t sample = value>>FILTER_EXTRA_BITS;
+    for (uint8_t i=0; i<FILTER_WINDOW; i++)
+        window[i] = sample;
+    window_sum = (uint32_t)sample*FILTER_WINDOW;
+    window_idx = 0;
+}
+
+
+// each sample replaces the oldest one in the window
+bool filter_put(uint16_t sample) {
+    window_sum += sample;
+    window_sum -= window[window_idx];
+    window[window_idx] = sample;
+    window_idx = (window_idx+1) & (FILTER_WINDOW-1);
+    return true;
+}
+
+
+uint16_t filter_value(void) {
+    return window_sum/(FILTER_WINDOW>>FILTER_EXTRA_BITS);
+}
+
+
+#elif FILTER_TYPE == FILTER_MEDIAN
+
+#if !(FILTER_MEDIAN_SIZE & 1) || (FILTER_MEDIAN_SIZE > 15)
+    #error "FILTER_MEDIAN_SIZE must be odd and not greater than 15"
+#endif
+
+// samples in order of arrival and the same samples sorted
+static uint16_t history[FILTER_MEDIAN_SIZE];
+static uint16_t sorted[FILTER_MEDIAN_SIZE];
+static uint8_t history_idx = 0;
+
+
+void filter_reset(uint16_t value) {
+    uint16_t sample = value>>FILTER_EXTRA_BITS;
+    for (uint8_t i=0; i<FILTER_MEDIAN_SIZE; i++) {
+        history[i] = sample;
+        sorted[i] = sample;
+    }
+    history_idx = 0;
+}
+
+
+/*
+ *  Replace the oldest sample in the sorted array by the new one and restore the
+ *  order by moving it to its place (insertion sort step)
+ */
+bool filter_put(uint16_t sample) {
+    uint16_t oldest = history[history_idx];
+    history[history_idx] = sample;
+    if (++history_idx == FILTER_MEDIAN_SIZE)
+        history_idx = 0;
+
+    uint8_t i = 0;
+    while (sorted[i] != oldest)
+        i++;
+    while ( (i > 0) && (sorted[i-1] > sample) ) {
+        sorted[i] = sorted[i-1];
+        i--;
+    }
+    while ( (i < FILTER_MEDIAN_SIZE-1) && (sorted[i+1] < sample) ) {
+        sorted[i] = sorted[i+1];
+        i++;
+    }
+    sorted[i] = sample;
+    return true;
+}
+
+
+uint16_t filter_value(void) {
+    return sorted[FILTER_MEDIAN_SIZE/2]<<FILTER_EXTRA_BITS;
+}
+
+
+#elif FILTER_TYPE == FILTER_IIR
+
+// output with FILTER_IIR_SHIFT fractional bits
+static uint32_t state = 0;
+
+
+void filter_reset(uint16_t value) {
+    state = (uint32_t)value<<FILTER_IIR_SHIFT;
+}
+
+
+bool filter_put(uint16_t sample) {
+    state -= state>>FILTER_IIR_SHIFT;
+    state += (uint32_t)sample<<FILTER_EXTRA_BITS;
+    return true;
+}
+
+
+uint16_t filter_value(void) {
+    return state>>FILTER_IIR_SHIFT;
+}
+
+
+#elif FILTER_TYPE == FILTER_OVERSAMPLING
+
+static uint16_t sum = 0;
+static uint8_t sum_cnt = 0;
+static uint16_t value = 0;
+
+
+void filter_reset(uint16_t new_value) {
+    value = new_value;
+    sum = 0;
+    sum_cnt = 0;
+}
+
+
+// 4^n samples sum has 2n more bits, n of them are noise so they are shifted out
+bool filter_put(uint16_t sample) {
+    sum += sample;
+    if (++sum_cnt < FILTER_DECIMATION)
+        return false;
+
+    value = sum>>FILTER_EXTRA_BITS;
+    sum = 0;
+    sum_cnt = 0;
+    return true;
+}
+
+
+uint16_t filter_value(void) {
+    return value;
+}
+
+
+#else
+    #error "Unknown FILTER_TYPE"
+#endif
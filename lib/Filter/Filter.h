@@ -0,0 +1,56 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ *  Streaming filter of the arc voltage samples. Every kernel takes constant time
+ *  per sample and uses only additions and shifts (divisions by powers of 2).
+ *  Input is 10-bit ADC value, output has FILTER_EXTRA_BITS more bits of resolution
+ *  (averaging kernels really gain them, others are just scaled to match):
+ *    - FILTER_MOVING_AVERAGE: mean of the last FILTER_WINDOW samples;
+ *    - FILTER_MEDIAN: running median of the last FILTER_MEDIAN_SIZE samples,
+ *      single spikes don't pass at all;
+ *    - FILTER_IIR: single-pole low-pass, y += (x-y)/2^FILTER_IIR_SHIFT;
+ *    - FILTER_OVERSAMPLING: sum of 4^FILTER_EXTRA_BITS samples decimated to the
+ *      output resolution, output rate is lower by the same factor.
+ */
+#define FILTER_MOVING_AVERAGE 0
+#define FILTER_MEDIAN 1
+#define FILTER_IIR 2
+#define FILTER_OVERSAMPLING 3
+
+#define FILTER_TYPE FILTER_MOVING_AVERAGE
+
+// 12-bit output
+#define FILTER_EXTRA_BITS 2
+#define FILTER_BITS (10+FILTER_EXTRA_BITS)
+
+// samples, power of 2 not greater than 128 (~7ms at default ADC rate)
+#define FILTER_WINDOW 64
+// samples, odd
+#define FILTER_MEDIAN_SIZE 5
+// time constant is 2^FILTER_IIR_SHIFT samples (~2ms at default ADC rate)
+#define FILTER_IIR_SHIFT 4
+
+// how many input samples give one output value
+#if FILTER_TYPE == FILTER_OVERSAMPLING
+    #define FILTER_DECIMATION (1<<(2*FILTER_EXTRA_BITS))
+#else
+    #define FILTER_DECIMATION 1
+#endif
+
+
+// start over as if the input was constant at given value (in output units)
+void filter_reset(uint16_t value);
+// returns true if there is a new output value
+bool filter_put(uint16_t sample);
+uint16_t filter_value(void);
+
+
+
+#endif /* FILTER_H_ */
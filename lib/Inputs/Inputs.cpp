@@ -0,0 +1,96 @@
+#include <Inputs.h>
+
+
+#if (INPUT_QUEUE_SIZE & (INPUT_QUEUE_SIZE-1)) || (INPUT_QUEUE_SIZE > 128)
+    #error "INPUT_QUEUE_SIZE must be a power of 2 not greater than 128"
+#endif
+
+// The pin change interrupt is the only writer, the tick is the only reader (the
+// interrupts don't nest so the writer may rewrite the newest edge when it's full)
+volatile InputEdge input_queue[INPUT_QUEUE_SIZE];
+volatile uint8_t input_head = 0;
+volatile uint8_t input_tail = 0;
+
+typedef struct {
+    uint16_t time;  // 0 - the pin is not watched
+    uint16_t count;  // integrator, 0 (low) to time (high)
+    uint8_t event;
+} Input;
+static Input inputs[INPUTS];
+
+static uint8_t levels;  // debounced
+static volatile uint8_t enabled = 0;
+static uint8_t captured;  // port after the last captured edge
+static uint16_t integrated_to;  // the integrators have counted till this time
+
+
+void inputs_init(uint8_t pins, uint16_t time) {
+    levels = pins;
+    captured = pins;
+    integrated_to = time;
+    enabled = 0;
+}
+
+
+void input_watch(uint8_t pin, uint16_t time, uint8_t event) {
+    Input *input = &inputs[pin];
+    input->time = time;
+    input->count = levels & (1<<pin) ? time : 0;
+    input->event = event;
+}
+
+
+// the tick only reads the mask so there is no need to lock it
+void input_enable(uint8_t pins) {
+    enabled |= pins;
+}
+
+
+void input_disable(uint8_t pins) {
+    enabled &= ~pins;
+}
+
+
+// the pins have been at the captured levels since the previous call
+static void integrate(uint16_t time) {
+    uint16_t elapsed = time - integrated_to;
+    // edges of the same moment (or stamped out of order) add nothing
+    if ((int16_t)elapsed <= 0)
+        return;
+    integrated_to = time;
+
+    for (uint8_t pin = 0; pin < INPUTS; pin++) {
+        Input *input = &inputs[pin];
+        if (!input->time) continue;
+        uint8_t mask = 1<<pin;
+
+        if (captured & mask)
+            input->count = input->time-input->count > elapsed ? input->count+elapsed : input->time;
+        else
+            input->count = input->count > elapsed ? input->count-elapsed : 0;
+
+        if ( (input->count == input->time && !(levels & mask)) ||
+             (input->count == 0 && (levels & mask)) ) {
+            levels ^= mask;
+            if (enabled & mask)
+                event_post(input->event);
+        }
+    }
+}
+
+
+void inputs_tick(uint16_t time) {
+    // edges since the previous tick, in the order they came
+    while (input_tail != input_head) {
+        volatile InputEdge *edge = &input_queue[input_tail & (INPUT_QUEUE_SIZE-1)];
+        integrate(edge->time);
+        captured = edge->pins;
+        input_tail++;
+    }
+    integrate(time);
+}
+
+
+bool input_level(uint8_t pin) {
+    return levels & (1<<pin);
+}
@@ -0,0 +1,70 @@
+#ifndef INPUTS_H_
+#define INPUTS_H_
+
+
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <Scheduler.h>
+
+
+/*
+ *  Digital inputs of one port (pin n is bit n). The pin change interrupt only
+ *  captures the port with a timestamp into a ring buffer (input_capture() is
+ *  inlined, a few cycles) so the ISR returns right away and no edge is lost
+ *  however many pins change at once (if the buffer is full the newest edge
+ *  takes the port, so the last level is never lost either). Debouncing is done
+ *  on the tick of the scheduler (inputs_tick()) from the captured edges: every
+ *  watched pin has an integrator counting the time it has been high up and the
+ *  time it has been low down, and its debounced level follows only when the
+ *  counter reaches one of the ends, i.e. after the given time of the stable
+ *  level. The pin's event is posted on every debounced change (if the pin is
+ *  enabled), the handler reads input_level()
+ */
+// must be a power of 2
+#define INPUT_QUEUE_SIZE 16
+#define INPUTS 8
+
+
+typedef struct {
+    uint16_t time;  // in the units of the application clock
+    uint8_t pins;  // port after the edge
+} InputEdge;
+
+
+// for input_capture() only
+extern volatile InputEdge input_queue[INPUT_QUEUE_SIZE];
+extern volatile uint8_t input_head;
+extern volatile uint8_t input_tail;
+
+
+// From the pin change interrupt: the port as it is now and the time of the edge
+static inline void input_capture(uint8_t pins, uint16_t time) {
+    uint8_t head = input_head;
+    if ((uint8_t)(head-input_tail) < INPUT_QUEUE_SIZE) {
+        input_queue[head & (INPUT_QUEUE_SIZE-1)].time = time;
+        input_queue[head & (INPUT_QUEUE_SIZE-1)].pins = pins;
+        input_head = head+1;
+    }
+    else {
+        input_queue[(head-1) & (INPUT_QUEUE_SIZE-1)].pins = pins;
+    }
+}
+
+// Current port is taken as debounced at the time of the clock, all pins are
+// disabled
+void inputs_init(uint8_t pins, uint16_t time);
+// Debounce the pin for the given time (in the units of the clock, 1-65535),
+// event is posted on its every debounced change
+void input_watch(uint8_t pin, uint16_t time, uint8_t event);
+// events of the pins (bit masks) on or off, levels are debounced all the time
+void input_enable(uint8_t pins);
+void input_disable(uint8_t pins);
+// From the scheduler tick with the clock as it is now
+void inputs_tick(uint16_t time);
+
+bool input_level(uint8_t pin);
+
+
+
+#endif /* INPUTS_H_ */
@@ -0,0 +1,167 @@
+#include <LCD.h>
+
+
+// HD44780 instructions
+#define LCD_CLEAR_DISPLAY 0x01
+#define LCD_ENTRY_MODE_INCREMENT 0x06
+#define LCD_DISPLAY_ON 0x0C
+#define LCD_FUNCTION_4BIT_2LINE 0x28
+#define LCD_SET_DDRAM_ADDRESS 0x80
+
+#define LCD_ROW_ADDRESS(row) ((row) ? 0x40 : 0x00)
+
+// what we want to see and what is on the screen right now
+static char frame[LCD_ROWS][LCD_COLS];
+static char shown[LCD_ROWS][LCD_COLS];
+
+static uint8_t cursor_col = 0;
+static uint8_t cursor_row = 0;
+
+// DDRAM address counter of the display (where the next data byte goes)
+static uint8_t address = 0;
+
+
+/*
+ *  E pulse must be at least 450ns long, data is set up (and read) within it
+ */
+static inline void strobe_high(void) {
+    LCD_E_PORT |= (1<<LCD_E);
+    _delay_us(1);
+}
+
+
+static inline void strobe_low(void) {
+    LCD_E_PORT &= ~(1<<LCD_E);
+    _delay_us(1);
+}
+
+
+static void write_nibble(uint8_t nibble) {
+    LCD_PORT = (LCD_PORT & ~LCD_DATA_MASK) | (nibble<<4);
+    strobe_high();
+    strobe_low();
+}
+
+
+static void write_byte(uint8_t byte, bool data) {
+    if (data)
+        LCD_RS_PORT |= (1<<LCD_RS);
+    else
+        LCD_RS_PORT &= ~(1<<LCD_RS);
+    write_nibble(byte>>4);
+    write_nibble(byte & 0x0F);
+}
+
+
+/*
+ *  Read the busy flag. In 4-bit mode the status is read as 2 nibbles, busy flag
+ *  is in the first one (the second one is the rest of the address counter)
+ */
+static bool busy(void) {
+    bool busy_flag;
+
+    LCD_DDR &= ~LCD_DATA_MASK;
+    LCD_PORT &= ~LCD_DATA_MASK;
+    LCD_RS_PORT &= ~(1<<LCD_RS);
+    LCD_PORT |= (1<<LCD_RW);
+
+    strobe_high();
+    busy_flag = LCD_PIN & (1<<LCD_BUSY);
+    strobe_low();
+    strobe_high();
+    strobe_low();
+
+    LCD_PORT &= ~(1<<LCD_RW);
+    LCD_DDR |= LCD_DATA_MASK;
+
+    return busy_flag;
+}
+
+
+void lcd_init(void) {
+    LCD_DDR |= LCD_DATA_MASK | (1<<LCD_RW);
+    LCD_PORT &= ~( LCD_DATA_MASK | (1<<LCD_RW) );
+    LCD_RS_DDR |= (1<<LCD_RS);
+    LCD_RS_PORT &= ~(1<<LCD_RS);
+    LCD_E_DDR |= (1<<LCD_E);
+    LCD_E_PORT &= ~(1<<LCD_E);
+
+    /*
+     *  Initialization by instruction (datasheet, figure 24). Busy flag can't be
+     *  checked yet so here we wait for real
+     */
+    _delay_ms(50);
+    write_nibble(0x03);
+    _delay_ms(5);
+    write_nibble(0x03);
+    _delay_us(150);
+    write_nibble(0x03);
+    _delay_us(150);
+    write_nibble(0x02);  // 4-bit mode from now on
+    _delay_us(50);
+
+    write_byte(LCD_FUNCTION_4BIT_2LINE, false);
+    _delay_us(50);
+    write_byte(LCD_DISPLAY_ON, false);
+    _delay_us(50);
+    write_byte(LCD_ENTRY_MODE_INCREMENT, false);
+    _delay_us(50);
+    write_byte(LCD_CLEAR_DISPLAY, false);
+    _delay_ms(2);
+
+    address = 0;
+    for (uint8_t row=0; row<LCD_ROWS; row++) {
+        for (uint8_t col=0; col<LCD_COLS; col++) {
+            frame[row][col] = ' ';
+            shown[row][col] = ' ';
+        }
+    }
+}
+
+
+void lcd_clear(void) {
+    for (uint8_t row=0; row<LCD_ROWS; row++)
+        for (uint8_t col=0; col<LCD_COLS; col++)
+            frame[row][col] = ' ';
+    cursor_col = 0;
+    cursor_row = 0;
+}
+
+
+void lcd_set_cursor(uint8_t col, uint8_t row) {
+    cursor_col = col;
+    cursor_row = row<LCD_ROWS ? row : LCD_ROWS-1;
+}
+
+
+void lcd_print(const char *str) {
+    while (*str && cursor_col<LCD_COLS)
+        frame[cursor_row][cursor_col++] = *str++;
+}
+
+
+bool lcd_update(void) {
+    for (uint8_t row=0; row<LCD_ROWS; row++) {
+        for (uint8_t col=0; col<LCD_COLS; col++) {
+            if (frame[row][col] == shown[row][col])
+                continue;
+
+            if (busy())
+                return true;
+
+            // move the address counter first if the cell isn't the next one
+            uint8_t cell_address = LCD_ROW_ADDRESS(row) + col;
+            if (address != cell_address) {
+                write_byte(LCD_SET_DDRAM_ADDRESS | cell_address, false);
+                address = cell_address;
+                return true;
+            }
+
+            write_byte(frame[row][col], true);
+            shown[row][col] = frame[row][col];
+            address++;
+            return true;
+        }
+    }
+    return false;
+}
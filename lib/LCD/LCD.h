@@ -0,0 +1,75 @@
+#ifndef LCD_H_
+#define LCD_H_
+
+
+
+#include <avr/io.h>
+#include <util/delay.h>
+#include <stdbool.h>
+
+
+/*
+ *  HD44780 (and compatible) driver in 4-bit mode. Nothing is sent to the display
+ *  right away: lcd_clear(), lcd_set_cursor() and lcd_print() only change the
+ *  framebuffer in RAM. lcd_update() compares it with what is currently shown and
+ *  sends only changed cells, one byte at a time. The busy flag is read through
+ *  the RW line so nobody ever waits for the display
+ */
+#define LCD_COLS 16
+#define LCD_ROWS 2
+
+// RW and D4-7 lines
+#define LCD_DDR DDRD
+#define LCD_PORT PORTD
+#define LCD_PIN PIND
+#define LCD_RW PD2  // Arduino 2
+#define LCD_DATA_MASK ((1<<PD4)|(1<<PD5)|(1<<PD6)|(1<<PD7))  // Arduino 4-7, D7 is the busy flag
+#define LCD_BUSY PD7
+
+/*
+ *  Uncomment to move RS line to PC4 (Arduino A4) and free PD1 (UART TX) for the
+ *  telemetry (see Telemetry.h). The motor driver mustn't write PC4 then (checked
+ *  at compile time), PhaseDriver on PORTC writes the whole port
+ */
+// #define LCD_RS_ON_PC4
+#ifdef LCD_RS_ON_PC4
+    #define LCD_RS_DDR DDRC
+    #define LCD_RS_PORT PORTC
+    #define LCD_RS PC4
+#else
+    #define LCD_RS_DDR DDRD
+    #define LCD_RS_PORT PORTD
+    #define LCD_RS PD1  // Arduino 1
+#endif
+
+/*
+ *  Uncomment to move E line to PB5 (Arduino 13). PD3 is occupied by STEP signal
+ *  when HwStepDirDriver is used
+ */
+// #define LCD_E_ON_PB5
+#ifdef LCD_E_ON_PB5
+    #define LCD_E_DDR DDRB
+    #define LCD_E_PORT PORTB
+    #define LCD_E PB5
+#else
+    #define LCD_E_DDR DDRD
+    #define LCD_E_PORT PORTD
+    #define LCD_E PD3  // Arduino 3
+#endif
+
+
+// blocks for ~50ms (power-up sequence), call it once at the start
+void lcd_init(void);
+
+void lcd_clear(void);
+void lcd_set_cursor(uint8_t col, uint8_t row);
+// string is cut at the end of the row
+void lcd_print(const char *str);
+
+// Send the next changed cell if the display is ready. Returns true if there is
+// still something to send
+bool lcd_update(void);
+
+
+
+#endif /* LCD_H_ */
@@ -0,0 +1,96 @@
+#ifndef MOTOR_H_
+#define MOTOR_H_
+
+
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <StepPlanner.h>
+#include <Pins.h>
+
+
+/*
+ *  Z-axis motor interface. A driver is a class of static functions only, with
+ *  its pins (see Pins.h) and settings as template parameters, so the firmware
+ *  calls it directly (no function pointers, no virtual calls) and everything
+ *  inlines down to the port instructions. Every driver provides:
+ *    - init();
+ *    - speed(int16_t speed) - continuous movement at ±speed steps per second
+ *      (positive is up), accelerating/decelerating smoothly, 0 is a smooth stop;
+ *    - move_to(int32_t position) - go to the absolute position in steps, returns
+ *      immediately;
+ *    - stop() - immediate stop (without deceleration), may be called from ISRs;
+ *    - busy() - whether the motor is still moving;
+ *    - position() - absolute position in steps counted from the power-up,
+ *      positive is up;
+ *    - the handlers of the interrupts it uses (the application routes all the
+ *      vectors below to its driver, unused handlers are empty).
+ *  Included drivers run on StepPlanner (Timer2 is the step timer): StepDirDriver
+ *  and HwStepDirDriver for "smart" STEP/DIR drivers and PhaseDriver for a
+ *  4-wire bipolar stepper plus set of switches. A DC motor with an encoder fits
+ *  the same interface: position() counted by the encoder, speed() and move_to()
+ *  closing the loop on it
+ */
+
+// steps per second for up/down movements and the upper limit for speed()
+// (acceleration profile is set in StepPlanner.h)
+#define MOTOR_SPEED 670
+#define MOTOR_MAX_SPEED PLANNER_MAX_SPEED
+
+
+/*
+ *  Timer traits: the Timer2 compare match which ends a step
+ */
+struct Timer2CompareA {
+    static void enable(void) { TIMSK2 |= (1<<OCIE2A); }
+    static void disable(void) { TIMSK2 &= ~(1<<OCIE2A); }
+};
+
+struct Timer2CompareB {
+    static void enable(void) { TIMSK2 |= (1<<OCIE2B); }
+    static void disable(void) { TIMSK2 &= ~(1<<OCIE2B); }
+};
+
+
+// Defaults of the drivers, a driver hides the ones it implements
+struct DriverBase {
+    // STEP is driven by Timer2 hardware (OC2B, PD3)
+    static const bool uses_oc2b = false;
+    // PORTC pins the driver writes (LCD RS may be moved to PC4, see LCD.h)
+    static const uint8_t portc_pins = 0;
+
+    static bool busy(void) {
+        return planner_busy();
+    }
+
+    static int32_t position(void) {
+        return planner_position();
+    }
+
+    static void timer2_compa(void) {}
+    static void timer2_compb(void) {}
+    static void timer1_compa(void) {}
+};
+
+
+// What the application calls: the driver plus the common movements
+template <class Driver>
+struct Motor : Driver {
+    static void up(void) {
+        Driver::speed(MOTOR_SPEED);
+    }
+
+    static void down(void) {
+        Driver::speed(-MOTOR_SPEED);
+    }
+
+    // Make ±steps steps in one or another direction. Returns immediately, check
+    // busy() to know when the movement is over
+    static void move(int16_t steps) {
+        Driver::move_to(Driver::position()+steps);
+    }
+};
+
+
+
+#endif /* MOTOR_H_ */
@@ -0,0 +1,257 @@
+#ifndef PHASEDRIVER_H_
+#define PHASEDRIVER_H_
+
+
+
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <Motor.h>
+#include <Profiler.h>
+
+
+/*
+ *  4-wire bipolar stepper motor plus set of switches (relays, discrete
+ *  transistors, array of transistors, driver IC and so on) on 4 pins in a row of
+ *  one port. We've used 42BYGHW208 stepper motor with such pinout:
+ *    First coil:
+ *      - A black
+ *      - C green
+ *    Second coil:
+ *      - B red
+ *      - D blue
+ *  Phases are switched in A-C-B-D order (first_pin and the next 3 ones), each
+ *  one is 90 electrical degrees after the previous one. Stepping modes:
+ *    - MOTOR_WAVE: one phase on at a time, the least torque;
+ *    - MOTOR_FULL_STEP: two phases on, ~1.4 times the torque of the wave mode;
+ *    - MOTOR_HALF_STEP: one and two phases on in turn, twice the resolution;
+ *    - MOTOR_MICROSTEP: sine and cosine currents by software PWM of the phase
+ *      pins (Timer1, so PROFILING can't be used), MOTOR_MICROSTEPS per full step.
+ *      Switches must take PWM (e.g. L298). Coils stay at a fixed duty per
+ *      microstep so the torque is even and the motion is smoother.
+ *  Patterns of the pins are tables made at compile time, every step (PWM slot
+ *  in the microstep mode) is one write of the whole port, so its other pins
+ *  must not be outputs or pulled up. A step of the planner (positions, cutting
+ *  height, speeds) is the step of the mode so scale STEPS_PER_MM (Units.h) and
+ *  the speeds along with it
+ */
+#define MOTOR_WAVE 0
+#define MOTOR_FULL_STEP 1
+#define MOTOR_HALF_STEP 2
+#define MOTOR_MICROSTEP 3
+
+// 2, 4 or 8
+#define MOTOR_MICROSTEPS 4
+// duty levels per PWM period, power of 2
+#define MOTOR_PWM_SLOTS 8
+#define MOTOR_PWM_FREQUENCY 2000  // Hz
+
+#if MOTOR_MICROSTEPS != 2 && MOTOR_MICROSTEPS != 4 && MOTOR_MICROSTEPS != 8
+    #error "MOTOR_MICROSTEPS must be 2, 4 or 8"
+#endif
+#if (MOTOR_PWM_SLOTS & (MOTOR_PWM_SLOTS-1)) || MOTOR_PWM_SLOTS > 16
+    #error "MOTOR_PWM_SLOTS must be a power of 2 not greater than 16"
+#endif
+#define MOTOR_PWM_TIMER_TOP (F_CPU/MOTOR_PWM_FREQUENCY/MOTOR_PWM_SLOTS - 1)
+#if MOTOR_PWM_TIMER_TOP > 0xFFFF
+    #error "MOTOR_PWM_FREQUENCY is too low for Timer1"
+#endif
+#ifdef PROFILING
+    #define MOTOR_PWM_TIMER_FREE false
+#else
+    #define MOTOR_PWM_TIMER_FREE true
+#endif
+
+
+template <class Port, uint8_t first_pin, uint8_t stepping = MOTOR_WAVE>
+class PhaseDriver : public DriverBase {
+public:
+    // coil patterns are written to the whole port
+    static const uint8_t portc_pins = SamePort<Port, PortC>::value ? 0xFF : 0;
+
+    static void init(void) {
+        Port::ddr() |= PINS;
+        planner_init();
+
+        if (stepping == MOTOR_MICROSTEP) {
+            // Timer1 in CTC mode without prescaler, one interrupt per PWM slot
+            TCCR1A = 0;
+            TCCR1B = (1<<WGM12)|(1<<CS10);
+            OCR1A = MOTOR_PWM_TIMER_TOP;
+        }
+    }
+
+    static void speed(int16_t speed) {
+        int8_t direction = planner_set_speed(speed);
+        if (direction)
+            start(direction);
+    }
+
+    static void move_to(int32_t position) {
+        int8_t direction = planner_move_to(position, MOTOR_MAX_SPEED);
+        if (direction)
+            start(direction);
+    }
+
+    static void stop(void) {
+        Timer2CompareA::disable();
+        if (stepping == MOTOR_MICROSTEP)
+            TIMSK1 &= ~(1<<OCIE1A);
+        planner_stop();
+        stopping = false;
+        Port::port() &= ~PINS;
+    }
+
+    // step timer
+    static void timer2_compa(void) {
+        PROFILE_ISR_BEGIN(PROFILE_MOTOR_ISR);
+
+        if (stopping)
+            stop();
+        else
+            step();
+
+        PROFILE_ISR_END(PROFILE_MOTOR_ISR);
+    }
+
+    // PWM of the coils
+    static void timer1_compa(void) {
+        PROFILE_ISR_BEGIN(PROFILE_MOTOR_ISR);
+
+        if (stepping == MOTOR_MICROSTEP) {
+            Port::port() = pgm_read_byte(&pwm_table[pwm_phase][pwm_slot]);
+            pwm_slot = (pwm_slot+1) & (MOTOR_PWM_SLOTS-1);
+        }
+
+        PROFILE_ISR_END(PROFILE_MOTOR_ISR);
+    }
+
+private:
+    // energize the coils for this step
+    static void step(void) {
+        // the phase next to the energized one in the direction of this step
+        if (step_direction > 0) {
+            if (++last_step == PHASES) last_step = 0;
+        }
+        else {
+            if (last_step-- == 0) last_step = PHASES-1;
+        }
+
+        if (stepping == MOTOR_MICROSTEP)
+            // PWM interrupt switches the pins from the next slot on
+            pwm_phase = last_step;
+        else
+            Port::port() = sequence[last_step];
+
+        // prepare the next step
+        step_direction = planner_step();
+        if (!step_direction)
+            stopping = true;
+    }
+
+    static_assert(stepping <= MOTOR_MICROSTEP, "Unknown stepping mode");
+    static_assert(stepping != MOTOR_MICROSTEP || MOTOR_PWM_TIMER_FREE,
+                  "Timer1 is taken by the profiling, microstepping can't be used");
+    static_assert(first_pin <= 4, "Phase pins don't fit the port");
+
+    static const uint8_t PHASES = stepping == MOTOR_MICROSTEP ? 4*MOTOR_MICROSTEPS :
+                                  stepping == MOTOR_HALF_STEP ? 8 : 4;
+    // half of the electrical period in microsteps
+    static const uint8_t HALF_PERIOD = 2*MOTOR_MICROSTEPS;
+    static const uint8_t PINS = 0x0F<<first_pin;
+
+    static constexpr uint8_t phase(uint8_t n) {
+        return 1<<(n%4 + first_pin);
+    }
+
+    // pins of the step (within the electrical period) in the full-step modes
+    static constexpr uint8_t step_pins(uint8_t step) {
+        return stepping == MOTOR_WAVE ? phase(step) :
+               stepping == MOTOR_FULL_STEP ? phase(step)|phase(step+1) :
+               step%2 ? phase(step/2)|phase(step/2+1) : phase(step/2);
+    }
+
+    /*
+     *  Duty of a coil (in PWM slots) at k/HALF_PERIOD of its half-period, i.e.
+     *  |sin(pi*k/HALF_PERIOD)| by Bhaskara's approximation (within 0.2%, integer only)
+     */
+    static constexpr uint8_t coil_duty(uint8_t k) {
+        return ( 2*16L*k*(HALF_PERIOD-k)*MOTOR_PWM_SLOTS /
+                 (5L*HALF_PERIOD*HALF_PERIOD - 4L*k*(HALF_PERIOD-k)) + 1 ) / 2;
+    }
+
+    // Coil driven by the (plus, minus) pins at microstep m of its own phase
+    static constexpr uint8_t coil_pins(uint8_t m, uint8_t slot, uint8_t plus, uint8_t minus) {
+        return slot < coil_duty(m % HALF_PERIOD) ? ( (m / HALF_PERIOD) % 2 ? minus : plus ) : 0;
+    }
+
+    // A-B coil is the cosine, C-D coil is the sine of the electrical angle
+    static constexpr uint8_t microstep_pins(uint8_t m, uint8_t slot) {
+        return coil_pins(m + MOTOR_MICROSTEPS, slot, phase(0), phase(2)) |
+               coil_pins(m, slot, phase(1), phase(3));
+    }
+
+    // Planner has decided to start the motor (and has already started the timer)
+    static void start(int8_t direction) {
+        step_direction = direction;
+        stopping = false;
+        Timer2CompareA::enable();
+        if (stepping == MOTOR_MICROSTEP)
+            TIMSK1 |= (1<<OCIE1A);
+    }
+
+    static const uint8_t sequence[8];
+    // pins for every PWM slot of every microstep (slots past MOTOR_PWM_SLOTS are unused)
+    static const uint8_t pwm_table[4*MOTOR_MICROSTEPS][16];
+
+    // energized phase (the rotor stays there when the coils are off)
+    static uint8_t last_step;
+    static int8_t step_direction;
+    // the last step is done, de-energize coils at the next timer event
+    static bool stopping;
+    // microstep the PWM is running, written by the step timer
+    static volatile uint8_t pwm_phase;
+    static uint8_t pwm_slot;
+};
+
+
+#define PHASE_DRIVER_TEMPLATE template <class Port, uint8_t first_pin, uint8_t stepping>
+#define PHASE_DRIVER PhaseDriver<Port, first_pin, stepping>
+
+PHASE_DRIVER_TEMPLATE
+const uint8_t PHASE_DRIVER::sequence[8] = {
+    step_pins(0), step_pins(1), step_pins(2), step_pins(3),
+    step_pins(4), step_pins(5), step_pins(6), step_pins(7)
+};
+
+#define PWM_ROW(m) { \
+    microstep_pins(m, 0), microstep_pins(m, 1), microstep_pins(m, 2), microstep_pins(m, 3), \
+    microstep_pins(m, 4), microstep_pins(m, 5), microstep_pins(m, 6), microstep_pins(m, 7), \
+    microstep_pins(m, 8), microstep_pins(m, 9), microstep_pins(m, 10), microstep_pins(m, 11), \
+    microstep_pins(m, 12), microstep_pins(m, 13), microstep_pins(m, 14), microstep_pins(m, 15) }
+#define PWM_ROWS4(m) PWM_ROW(m), PWM_ROW(m+1), PWM_ROW(m+2), PWM_ROW(m+3)
+
+PHASE_DRIVER_TEMPLATE
+const uint8_t PHASE_DRIVER::pwm_table[4*MOTOR_MICROSTEPS][16] PROGMEM = {
+    PWM_ROWS4(0), PWM_ROWS4(4),
+#if MOTOR_MICROSTEPS >= 4
+    PWM_ROWS4(8), PWM_ROWS4(12),
+#endif
+#if MOTOR_MICROSTEPS == 8
+    PWM_ROWS4(16), PWM_ROWS4(20), PWM_ROWS4(24), PWM_ROWS4(28),
+#endif
+};
+
+PHASE_DRIVER_TEMPLATE uint8_t PHASE_DRIVER::last_step = 0;
+PHASE_DRIVER_TEMPLATE int8_t PHASE_DRIVER::step_direction = 0;
+PHASE_DRIVER_TEMPLATE bool PHASE_DRIVER::stopping = false;
+PHASE_DRIVER_TEMPLATE volatile uint8_t PHASE_DRIVER::pwm_phase = 0;
+PHASE_DRIVER_TEMPLATE uint8_t PHASE_DRIVER::pwm_slot = 0;
+
+#undef PWM_ROWS4
+#undef PWM_ROW
+#undef PHASE_DRIVER
+#undef PHASE_DRIVER_TEMPLATE
+
+
+
+#endif /* PHASEDRIVER_H_ */
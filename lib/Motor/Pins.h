@@ -0,0 +1,65 @@
+#ifndef PINS_H_
+#define PINS_H_
+
+
+
+#include <avr/io.h>
+#include <stdbool.h>
+
+
+/*
+ *  Pin traits for the motor drivers. A port is a type giving its three registers
+ *  and a pin is a port plus a bit, both as template parameters, so every
+ *  operation is known at compile time: set/clear of one pin becomes a single
+ *  sbi/cbi instruction (the registers of ports B, C and D are in the I/O space)
+ *  without any pin tables or pointers in RAM. Registers are returned by
+ *  reference instead of being template parameters themselves because an AVR
+ *  register is an address cast, not a constant expression (and it's a plain
+ *  variable in the host build, see host/include/avr/io.h)
+ */
+#define PORT_TRAITS(name, letter) \
+    struct name { \
+        static volatile uint8_t &ddr(void) { return DDR##letter; } \
+        static volatile uint8_t &port(void) { return PORT##letter; } \
+        static volatile uint8_t &pin(void) { return PIN##letter; } \
+    }
+
+PORT_TRAITS(PortB, B);
+PORT_TRAITS(PortC, C);
+PORT_TRAITS(PortD, D);
+
+
+template <class Port, uint8_t bit>
+struct Pin {
+    typedef Port port;
+    static const uint8_t mask = 1<<bit;
+
+    static void output(void) { Port::ddr() |= mask; }
+    static void input(void) { Port::ddr() &= ~mask; }
+    static void high(void) { Port::port() |= mask; }
+    static void low(void) { Port::port() &= ~mask; }
+    static void write(bool value) { if (value) high(); else low(); }
+    static bool read(void) { return Port::pin() & mask; }
+};
+
+
+// Compile-time check of a port (pins that mustn't meet other signals)
+template <class Port, class OtherPort>
+struct SamePort {
+    static const bool value = false;
+};
+
+template <class Port>
+struct SamePort<Port, Port> {
+    static const bool value = true;
+};
+
+// the mask of the pin if it's on the port, 0 otherwise
+template <class Port, class P>
+struct PinMask {
+    static const uint8_t value = SamePort<typename P::port, Port>::value ? P::mask : 0;
+};
+
+
+
+#endif /* PINS_H_ */
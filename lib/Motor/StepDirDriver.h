@@ -0,0 +1,164 @@
+#ifndef STEPDIRDRIVER_H_
+#define STEPDIRDRIVER_H_
+
+
+
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <Motor.h>
+#include <Profiler.h>
+
+
+/*
+ *  "Smart" drivers controlled by 2 signals: STEP and DIRECTION. DIR is set right
+ *  after a step for the next one, which gives the driver plenty of setup time.
+ *  Template parameters are the pins (Pin<PortC, PC2> etc.) and the STEP pulse
+ *  width in microseconds
+ */
+template <class Dir, class Step, uint8_t pulse = 20>
+struct StepDirDriver : DriverBase {
+    static const uint8_t portc_pins = PinMask<PortC, Dir>::value | PinMask<PortC, Step>::value;
+
+    static void init(void) {
+        Step::output();
+        Dir::output();
+        planner_init();
+    }
+
+    static void speed(int16_t speed) {
+        int8_t direction = planner_set_speed(speed);
+        if (direction)
+            start(direction);
+    }
+
+    static void move_to(int32_t position) {
+        int8_t direction = planner_move_to(position, MOTOR_MAX_SPEED);
+        if (direction)
+            start(direction);
+    }
+
+    static void stop(void) {
+        Timer2CompareA::disable();
+        planner_stop();
+        Step::low();
+        Dir::low();
+    }
+
+    // step timer
+    static void timer2_compa(void) {
+        PROFILE_ISR_BEGIN(PROFILE_MOTOR_ISR);
+
+        // DIR has been already set for this step
+        Step::high();
+        _delay_us(pulse);
+        Step::low();
+
+        // prepare the next one
+        int8_t direction = planner_step();
+        if (direction)
+            Dir::write(direction > 0);
+        else
+            stop();
+
+        PROFILE_ISR_END(PROFILE_MOTOR_ISR);
+    }
+
+private:
+    // Planner has decided to start the motor (and has already started the timer)
+    static void start(int8_t direction) {
+        Dir::write(direction > 0);
+        Timer2CompareA::enable();
+    }
+};
+
+
+/*
+ *  STEP pulses are formed by Timer2 hardware (OC2B output, fast PWM mode) instead
+ *  of the ISR. There is no waiting for the pulse end in the ISR anymore (it only
+ *  plans the next step) so much higher step rates are possible. STEP must be
+ *  connected to PD3 (Arduino 3) then and LCD E line is moved to PB5 (Arduino 13)
+ *  (define LCD_E_ON_PB5 in LCD.h). Pulse width is a half of the period
+ */
+template <class Dir>
+struct HwStepDirDriver : DriverBase {
+    typedef Pin<PortD, PD3> Step;  // OC2B
+    static const bool uses_oc2b = true;
+    static const uint8_t portc_pins = PinMask<PortC, Dir>::value;
+    // us, the shortest STEP pulse the driver takes (when a stop cuts one short)
+    static const uint8_t min_pulse = 2;
+
+    static void init(void) {
+        Step::output();
+        Dir::output();
+        planner_init();
+    }
+
+    static void speed(int16_t speed) {
+        int8_t direction = planner_set_speed(speed);
+        if (direction)
+            start(direction);
+    }
+
+    static void move_to(int32_t position) {
+        int8_t direction = planner_move_to(position, MOTOR_MAX_SPEED);
+        if (direction)
+            start(direction);
+    }
+
+    static void stop(void) {
+        Timer2CompareB::disable();
+        // A pulse that has begun (or has ended but the ISR hasn't counted it yet)
+        // is a step already: count it before the planner forgets its direction
+        bool pulse = Step::read();
+        if ( pulse || (TIFR2 & (1<<OCF2B)) )
+            planner_step();
+        planner_stop();
+        // stop the timer, give STEP pin back to PORT (without cutting the pulse
+        // short) and return to CTC mode
+        Step::write(pulse);
+        planner_init();
+        if (pulse)
+            _delay_us(min_pulse);
+        Step::low();
+        Dir::low();
+    }
+
+    // the pulse has just ended (the step is done), prepare the next one
+    static void timer2_compb(void) {
+        PROFILE_ISR_BEGIN(PROFILE_MOTOR_ISR);
+
+        int8_t direction = planner_step();
+        // There is a half of the period till the next pulse so DIR has enough
+        // setup time. On stop the pin is disconnected from the timer before that
+        if (direction)
+            Dir::write(direction > 0);
+        else
+            stop();
+
+        PROFILE_ISR_END(PROFILE_MOTOR_ISR);
+    }
+
+private:
+    static void start(int8_t direction) {
+        Dir::write(direction > 0);
+
+        // Planner has written compare registers in CTC mode (where they are not
+        // buffered). Now switch to fast PWM with TOP=OCR2A: OC2B is set at BOTTOM
+        // (step) and cleared at OCR2B match. The counter starts at OCR2B (the write
+        // blocks that match) so the first pulse goes out at BOTTOM in a half of the
+        // period before the first OCR2B match counts it, and a restarted movement
+        // still keeps about a period after the last pulse
+        TCNT2 = OCR2B;
+        TCCR2A = (1<<COM2B1)|(1<<WGM21)|(1<<WGM20);
+        TCCR2B |= (1<<WGM22);
+
+        // STEP pulse ends at OCR2B match so this interrupt means the step is done.
+        // A match left from the previous movement isn't a step of this one
+        TIFR2 = (1<<OCF2B);
+        Timer2CompareB::enable();
+    }
+};
+
+
+
+#endif /* STEPDIRDRIVER_H_ */
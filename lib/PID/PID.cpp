@@ -0,0 +1,60 @@
+#include <PID.h>
+
+
+void pid_init(PID *pid, uint16_t kp, uint16_t ki, uint16_t kd,
+              int16_t deadband, int16_t output_max) {
+    pid->kp = kp;
+    pid->ki = ki;
+    pid->kd = kd;
+    pid->deadband = deadband;
+    pid->output_max = output_max;
+    // anti-windup: integral term alone can't exceed the output limit
+    if (ki)
+        pid->integral_max = ((int32_t)output_max*PID_GAIN_SCALE)/ki;
+    else
+        pid->integral_max = 0;
+    pid_reset(pid, 0);
+}
+
+
+// Forget the history, e.g. before the regulation start
+void pid_reset(PID *pid, int16_t input) {
+    pid->integral = 0;
+    pid->prev_input = input;
+}
+
+
+int16_t pid_update(PID *pid, int16_t setpoint, int16_t input) {
+    int16_t error = setpoint-input;
+    int16_t input_delta = input-pid->prev_input;
+    pid->prev_input = input;
+
+    // Inside the deadband we do nothing and also drop the integral so it can't
+    // push us out of the band later (that's what makes bang-bang regulators hunt)
+    if ( (error <= pid->deadband) && (error >= -pid->deadband) ) {
+        pid->integral = 0;
+        return 0;
+    }
+    // measure error from the band edge so the output is continuous
+    if (error > 0)
+        error -= pid->deadband;
+    else
+        error += pid->deadband;
+
+    pid->integral += error;
+    if (pid->integral > pid->integral_max)
+        pid->integral = pid->integral_max;
+    else if (pid->integral < -pid->integral_max)
+        pid->integral = -pid->integral_max;
+
+    int32_t output = (int32_t)pid->kp*error + (int32_t)pid->ki*pid->integral -
+                     (int32_t)pid->kd*input_delta;
+    output /= PID_GAIN_SCALE;
+
+    if (output > pid->output_max)
+        output = pid->output_max;
+    else if (output < -pid->output_max)
+        output = -pid->output_max;
+
+    return output;
+}
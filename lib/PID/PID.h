@@ -0,0 +1,40 @@
+#ifndef PID_H_
+#define PID_H_
+
+
+
+#include <stdint.h>
+
+
+/*
+ *  Fixed-point PID regulator with deadband. Gains are integers in
+ *  1/PID_GAIN_SCALE units and are applied per call, i.e. integral is the
+ *  plain sum of errors and derivative is the difference between two
+ *  consecutive inputs (on measurement, so there is no kick on setpoint change)
+ */
+#define PID_GAIN_SHIFT 6
+#define PID_GAIN_SCALE (1<<PID_GAIN_SHIFT)
+
+
+typedef struct {
+    uint16_t kp;
+    uint16_t ki;
+    uint16_t kd;
+    // errors within ±deadband give zero output
+    int16_t deadband;
+    // output is limited to ±output_max
+    int16_t output_max;
+    int32_t integral;
+    int32_t integral_max;
+    int16_t prev_input;
+} PID;
+
+
+void pid_init(PID *pid, uint16_t kp, uint16_t ki, uint16_t kd,
+              int16_t deadband, int16_t output_max);
+void pid_reset(PID *pid, int16_t input);
+int16_t pid_update(PID *pid, int16_t setpoint, int16_t input);
+
+
+
+#endif /* PID_H_ */
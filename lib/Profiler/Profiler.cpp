@@ -0,0 +1,114 @@
+#include <Profiler.h>
+
+#ifdef PROFILING
+
+#include <avr/eeprom.h>
+
+
+#define STACK_PAINT 0xC5
+
+// end of .data and .bss (set by the linker), the stack grows down towards it
+extern uint8_t _end;
+
+static volatile ProfileStats stats[PROFILE_ISRS];
+static volatile uint16_t control_latency_max = 0;
+static volatile uint16_t missed_ticks = 0;
+
+static ProfileSnapshot EEMEM snapshot_EEPROM;
+
+
+void profiler_init(void) {
+    // paint everything between the variables and the current stack top (main()
+    // has hardly used anything yet)
+    uint8_t *p = &_end;
+    uint8_t *top = (uint8_t *)(uintptr_t)SP;
+    while (p < top)
+        *p++ = STACK_PAINT;
+
+    profiler_reset();
+
+    // normal mode, no prescaler
+    TCCR1A = 0;
+    TCCR1B = (1<<CS10);
+}
+
+
+static void stats_update(volatile ProfileStats *isr_stats, uint16_t cycles) {
+    if (isr_stats->sum+cycles < isr_stats->sum) {
+        isr_stats->sum >>= 1;
+        isr_stats->count >>= 1;
+    }
+    isr_stats->sum += cycles;
+    isr_stats->count++;
+    if (cycles < isr_stats->min)
+        isr_stats->min = cycles;
+    if (cycles > isr_stats->max)
+        isr_stats->max = cycles;
+}
+
+
+// Called at the ISR end (interrupts are disabled) with its starting timestamp
+void profiler_isr_done(uint8_t isr, uint16_t start) {
+    stats_update(&stats[isr], TCNT1-start);
+}
+
+
+void profiler_control_latency(uint16_t cycles) {
+    if (cycles > control_latency_max)
+        control_latency_max = cycles;
+}
+
+
+// Next control tick is already due: this one (with its latency) took the whole period
+void profiler_control_done(void) {
+    if ( (TIFR0 & (1<<OCF0A)) && missed_ticks != UINT16_MAX )
+        missed_ticks++;
+}
+
+
+static uint16_t stack_free(void) {
+    const uint8_t *p = &_end;
+    while (p <= (const uint8_t *)RAMEND && *p == STACK_PAINT)
+        p++;
+    return p - &_end;
+}
+
+
+void profiler_snapshot(ProfileSnapshot *snapshot) {
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PROFILE_ISRS; i++) {
+        snapshot->isr[i].count = stats[i].count;
+        snapshot->isr[i].sum = stats[i].sum;
+        snapshot->isr[i].min = stats[i].count ? stats[i].min : 0;
+        snapshot->isr[i].max = stats[i].max;
+    }
+    snapshot->control_latency_max = control_latency_max;
+    snapshot->missed_ticks = missed_ticks;
+    SREG = sreg;
+
+    snapshot->stack_free = stack_free();
+    snapshot->stack_used = (const uint8_t *)(RAMEND+1) - &_end - snapshot->stack_free;
+}
+
+
+void profiler_dump(const ProfileSnapshot *snapshot) {
+    eeprom_update_block(snapshot, &snapshot_EEPROM, sizeof(ProfileSnapshot));
+}
+
+
+void profiler_reset(void) {
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t i = 0; i < PROFILE_ISRS; i++) {
+        stats[i].count = 0;
+        stats[i].sum = 0;
+        stats[i].min = UINT16_MAX;
+        stats[i].max = 0;
+    }
+    control_latency_max = 0;
+    missed_ticks = 0;
+    SREG = sreg;
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdbool.h>
+
+
+/*
+ *  Uncomment to build in the profiling of the interrupt handlers. Timer1 (unused
+ *  otherwise) runs free at F_CPU and timestamps entry and exit of every profiled
+ *  ISR, so min/avg/max durations are known in CPU cycles (the prologue and the
+ *  epilogue generated by the compiler are not counted). The control tick also
+ *  reports its latency (Timer0 counts since the compare match) and a missed
+ *  tick when the next one is already due at its exit. Free stack is measured by
+ *  the painted area that has never been touched.
+ *  Commented out, all the macros below are empty and nothing is linked in
+ */
+// #define PROFILING
+
+enum ProfiledIsr {
+    PROFILE_CONTROL_ISR,  // TIMER0_COMPA_vect
+    PROFILE_MOTOR_ISR,  // TIMER2_COMPx_vect
+    PROFILE_ADC_ISR,
+    PROFILE_SIGNALS_ISR,  // PCINT0_vect
+    PROFILE_TELEMETRY_ISR,  // USART_UDRE_vect
+
+    PROFILE_ISRS
+};
+
+
+#ifdef PROFILING
+
+// durations are in CPU cycles (Timer1 wraps in 65536 cycles, that is a whole
+// 4ms control tick at 16MHz: anything longer is not measured correctly anyway)
+typedef struct {
+    uint32_t count;
+    uint32_t sum;  // halved together with count before overflow, so avg stays right
+    uint16_t min;
+    uint16_t max;
+} ProfileStats;
+
+typedef struct {
+    ProfileStats isr[PROFILE_ISRS];
+    uint16_t control_latency_max;  // cycles
+    uint16_t missed_ticks;
+    uint16_t stack_used;  // bytes
+    uint16_t stack_free;
+} ProfileSnapshot;
+
+// Call at the very beginning of main() (interrupts disabled): starts Timer1 and
+// paints the free RAM
+void profiler_init(void);
+void profiler_isr_done(uint8_t isr, uint16_t start);
+void profiler_control_latency(uint16_t cycles);
+void profiler_control_done(void);
+// consistent copy of everything, safe to call from the main loop
+void profiler_snapshot(ProfileSnapshot *snapshot);
+// the last snapshot is kept in EEPROM to be read out by the programmer
+void profiler_dump(const ProfileSnapshot *snapshot);
+void profiler_reset(void);
+
+    #define PROFILE_ISR_BEGIN(isr) uint16_t profile_start_ = TCNT1
+    #define PROFILE_ISR_END(isr) profiler_isr_done(isr, profile_start_)
+    #define PROFILE_CONTROL_LATENCY(cycles) profiler_control_latency(cycles)
+    #define PROFILE_CONTROL_DONE() profiler_control_done()
+
+#else
+
+    #define PROFILE_ISR_BEGIN(isr)
+    #define PROFILE_ISR_END(isr)
+    #define PROFILE_CONTROL_LATENCY(cycles)
+    #define PROFILE_CONTROL_DONE()
+
+#endif
+
+
+
+#endif /* PROFILER_H_ */
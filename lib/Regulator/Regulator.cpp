@@ -0,0 +1,221 @@
+#include <Regulator.h>
+
+
+uint16_t feedback = 0;
+uint16_t feedback_avrg = 0;
+uint16_t setpoint = 0;
+bool setpoint_defined = false;
+uint8_t setpoint_confidence = 0;
+
+static RegulatorSettings settings;
+// filter starts from the first sample of the arc
+static bool filter_started = false;
+// new filtered value since the previous tick
+static bool new_value = false;
+static RunningStats setpoint_stats;
+#ifdef PID_REGULATION
+static PID pid;
+#endif
+#ifdef SLOPE_CORRECTION
+// side of the error out of the hysteresis (0 - within) and ticks it has stayed there
+static int8_t error_side = 0;
+static uint8_t error_ticks = 0;
+#endif
+
+#ifdef ANTI_DIVE
+#if (ANTI_DIVE_WINDOW & (ANTI_DIVE_WINDOW-1)) || (ANTI_DIVE_WINDOW > 128)
+    #error "ANTI_DIVE_WINDOW must be a power of 2 not greater than 128"
+#endif
+// IIR state is the value times 2^ANTI_DIVE_IIR_SHIFT
+static uint16_t watch_sum;
+// values of the last ANTI_DIVE_WINDOW samples
+static uint16_t watch_history[ANTI_DIVE_WINDOW];
+static uint8_t watch_idx = 0;
+// history is filled anew with the first sample of the session
+static bool watch_started = false;
+static uint16_t lock_samples = 0;
+static bool hold = false;
+#endif
+
+
+void regulator_start(const RegulatorSettings *new_settings) {
+    // regulator_watch() uses the settings and the setpoint in ADC interrupt
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        settings = *new_settings;
+        filter_started = false;
+        new_value = false;
+        stats_reset(&setpoint_stats);
+        setpoint_defined = false;
+        #ifdef SLOPE_CORRECTION
+            error_side = 0;
+            error_ticks = 0;
+        #endif
+        #ifdef ANTI_DIVE
+            watch_started = false;
+            lock_samples = 0;
+        #endif
+    }
+}
+
+
+void regulator_sample(uint16_t sample) {
+    feedback = sample;
+
+    if (!filter_started) {
+        filter_reset(sample<<FILTER_EXTRA_BITS);
+        filter_started = true;
+    }
+
+    if ( filter_put(sample) ) {
+        feedback_avrg = filter_value();
+        new_value = true;
+    }
+}
+
+
+uint8_t regulator_tick(int16_t *command) {
+    uint8_t result = REGULATOR_COMMAND;
+
+    // Define setpoint by running statistics of the filtered values
+    if (setpoint_defined == false) {
+        if (!new_value) return REGULATOR_DEFINING_SETPOINT;
+        new_value = false;
+        stats_add(&setpoint_stats, feedback_avrg);
+
+        if ( !( (setpoint_stats.count >= settings.setpoint_min_ticks &&
+                 stats_converged(&setpoint_stats, settings.setpoint_tolerance)) ||
+                setpoint_stats.count >= settings.setpoint_max_ticks ) )
+            return REGULATOR_DEFINING_SETPOINT;
+
+        setpoint_defined = true;
+        setpoint = stats_mean(&setpoint_stats);
+        setpoint_confidence = stats_confidence(&setpoint_stats, settings.setpoint_tolerance);
+
+        #ifdef PID_REGULATION
+            pid_init(&pid, settings.kp, settings.ki, settings.kd,
+                     settings.setpoint_offset<<FILTER_EXTRA_BITS, settings.speed);
+            pid_reset(&pid, setpoint);
+        #endif
+
+        result = REGULATOR_SETPOINT_DEFINED;
+    }
+    new_value = false;
+
+#ifdef ANTI_DIVE
+    if (regulator_locked()) {
+        *command = 0;
+        #ifdef PID_REGULATION
+            // continue smoothly from the value seen after the lock
+            pid_reset(&pid, feedback_avrg);
+        #endif
+        return result;
+    }
+#endif
+
+    // make a decision on each tick
+#ifdef PID_REGULATION
+    // positive output (arc voltage is lower than setpoint) means lift up
+    *command = pid_update(&pid, setpoint, feedback_avrg);
+#else
+    int16_t offset = settings.setpoint_offset<<FILTER_EXTRA_BITS;
+    #ifdef SLOPE_CORRECTION
+        // towards the setpoint height in one move once the error is confirmed
+        int16_t error = (int16_t)feedback_avrg - (int16_t)setpoint;
+        int8_t side = error > offset ? 1 : (error < -offset ? -1 : 0);
+        if (side != error_side) {
+            error_side = side;
+            error_ticks = 0;
+        }
+        if ( settings.slope && result == REGULATOR_COMMAND && side ) {
+            if (++error_ticks < SLOPE_CORRECTION_CONFIRM_TICKS) {
+                *command = 0;
+                return result;
+            }
+            error_ticks = 0;
+            int32_t steps = -((int32_t)error*SLOPE_CORRECTION_GAIN)/settings.slope;
+            if (steps > SLOPE_CORRECTION_MAX_STEPS)
+                steps = SLOPE_CORRECTION_MAX_STEPS;
+            else if (steps < -SLOPE_CORRECTION_MAX_STEPS)
+                steps = -SLOPE_CORRECTION_MAX_STEPS;
+            *command = steps;
+            return REGULATOR_MOVE;
+        }
+    #endif
+    // lift up if torch is too low (taking into account the hysteresis interval)
+    if ((int16_t)feedback_avrg < (int16_t)setpoint-offset)
+        *command = settings.speed;
+    // get down if torch is too high (taking into account the hysteresis interval)
+    else if ((int16_t)feedback_avrg > (int16_t)setpoint+offset)
+        *command = -settings.speed;
+    // otherwise stop
+    else
+        *command = 0;
+#endif
+
+    return result;
+}
+
+
+void regulator_stop(void) {
+    feedback_avrg = 0;
+    setpoint_defined = false;
+}
+
+
+#ifdef SLOPE_CORRECTION
+void regulator_set_slope(uint16_t slope) {
+    settings.slope = slope;
+}
+
+
+void regulator_move_done(void) {
+    error_ticks = 0;
+}
+#endif
+
+
+#ifdef ANTI_DIVE
+
+bool regulator_watch(uint16_t sample) {
+    uint16_t value = sample<<FILTER_EXTRA_BITS;
+    if (!watch_started) {
+        watch_sum = value<<ANTI_DIVE_IIR_SHIFT;
+        for (uint8_t i = 0; i < ANTI_DIVE_WINDOW; i++)
+            watch_history[i] = value;
+        watch_started = true;
+    }
+
+    watch_sum += value - (watch_sum>>ANTI_DIVE_IIR_SHIFT);
+    value = watch_sum>>ANTI_DIVE_IIR_SHIFT;
+    uint16_t window_start = watch_history[watch_idx];
+    watch_history[watch_idx] = value;
+    watch_idx = (watch_idx+1) & (ANTI_DIVE_WINDOW-1);
+
+    bool was_locked = regulator_locked();
+    if (lock_samples)
+        lock_samples--;
+
+    // jump up out of the regulation band
+    if ( setpoint_defined &&
+         (int16_t)value > (int16_t)(setpoint + (settings.setpoint_offset<<FILTER_EXTRA_BITS) + ANTI_DIVE_THRESHOLD) &&
+         (int16_t)(value-window_start) > ANTI_DIVE_SLOPE )
+        lock_samples = ANTI_DIVE_HOLD_OFF;
+
+    return !was_locked && regulator_locked();
+}
+
+
+void regulator_hold(bool new_hold) {
+    hold = new_hold;
+}
+
+
+bool regulator_locked(void) {
+    bool locked;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        locked = hold || lock_samples;
+    }
+    return locked;
+}
+
+#endif
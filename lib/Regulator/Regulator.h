@@ -0,0 +1,162 @@
+#ifndef REGULATOR_H_
+#define REGULATOR_H_
+
+
+
+#include <util/atomic.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <Filter.h>
+#include <RunningStats.h>
+
+
+/*
+ *  Control algorithm itself: arc voltage samples in, motor commands out. It
+ *  knows nothing about the hardware so exactly the same code runs in the
+ *  control timer interrupt of the firmware and in the host tools (replay of the
+ *  recorded traces, tuning). Sampling, filtering and decision making are set up
+ *  independently:
+ *    - arc voltage is sampled by ADC in the background (see ADC.h, ~9kHz by
+ *      default) and each sample is given to regulator_sample();
+ *    - every sample goes through the streaming filter (see Filter.h for the
+ *      available kinds and their settings);
+ *    - regulator_tick() makes a decision CONTROL_RATE times per second.
+ *  So the filter may remember more samples than the decision period has
+ *  and we react fast without making the estimate noisier
+ */
+#define CONTROL_RATE 250  // Hz
+#define MS_TO_TICKS(ms) ((uint32_t)(ms)*CONTROL_RATE/1000)
+
+
+/*
+ *  Regulation mode. By default the torch is moved up or down at the constant
+ *  speed when the arc voltage leaves the setpoint ± setpoint_offset interval.
+ *  Uncomment to use PID regulator instead: its output sets both direction and
+ *  speed of the motor while setpoint_offset becomes its deadband. Gains are
+ *  set in the settings menu
+ */
+// #define PID_REGULATION
+#ifdef PID_REGULATION
+    #include <PID.h>
+#endif
+
+
+/*
+ *  Uncomment to correct the height in one motion in the default mode. Once the
+ *  arc voltage per step (slope) is known, the error out of the hysteresis is
+ *  converted into the steps to the setpoint (up to SLOPE_CORRECTION_MAX_STEPS)
+ *  and given as REGULATOR_MOVE instead of the constant speed. The slope is
+ *  measured by the application (a small known move at the cutting height).
+ *  The error must stay on one side out of the hysteresis for
+ *  SLOPE_CORRECTION_CONFIRM_TICKS in a row (the torch is held meanwhile) so a
+ *  spike or the noise doesn't start a move, and a move corrects
+ *  SLOPE_CORRECTION_GAIN/256 of it (the rest is left to the next one, after the
+ *  filter has seen the new height)
+ */
+// #define SLOPE_CORRECTION
+#define SLOPE_CORRECTION_MAX_STEPS 200
+#define SLOPE_CORRECTION_CONFIRM_TICKS 4
+#define SLOPE_CORRECTION_GAIN 224
+#if defined(SLOPE_CORRECTION) && defined(PID_REGULATION)
+    #error "SLOPE_CORRECTION is for the default regulation mode"
+#endif
+
+
+/*
+ *  Setpoint is automatically defined at regulation start as the mean of the
+ *  filtered arc voltage (one value per control tick). It is done as soon as the
+ *  standard error of the mean is within SETPOINT_TOLERANCE but not earlier than
+ *  SETPOINT_MIN_TIME. Noisy arc is cut off by SETPOINT_MAX_TIME and the mean so
+ *  far is taken anyway (with lower confidence)
+ */
+#define SETPOINT_MIN_TIME 40  // ms
+#define SETPOINT_MAX_TIME 1000  // ms
+#define SETPOINT_TOLERANCE 4  // FILTER_BITS-bit units, ~5mV at FEEDBACK pin
+
+
+/*
+ *  Anti-dive. Crossing a kerf or a hole edge makes the arc voltage jump up and
+ *  the regulation would drive the torch down into the plate. Uncomment to watch
+ *  every sample (regulator_watch() right from the ADC interrupt) through a fast
+ *  IIR filter of its own, apart from the main one: the height is locked as soon
+ *  as the value is more than ANTI_DIVE_THRESHOLD above the setpoint+offset and
+ *  has risen by more than ANTI_DIVE_SLOPE within ANTI_DIVE_WINDOW samples. The
+ *  lock holds for ANTI_DIVE_HOLD_OFF samples after the last such one. The CNC
+ *  can lock the height as well (regulator_hold(), e.g. while slowing down in
+ *  corners)
+ */
+// #define ANTI_DIVE
+// time constant is 2^ANTI_DIVE_IIR_SHIFT samples (~1ms at default ADC rate)
+#define ANTI_DIVE_IIR_SHIFT 3
+// samples, power of 2 (~2ms at default ADC rate)
+#define ANTI_DIVE_WINDOW 16
+// FILTER_BITS-bit units (~50mV at FEEDBACK pin, a few volts of the arc)
+#define ANTI_DIVE_THRESHOLD 40
+#define ANTI_DIVE_SLOPE 40
+// samples (~100ms at default ADC rate)
+#define ANTI_DIVE_HOLD_OFF 900
+
+
+typedef struct {
+    // hysteresis (setpoint ± setpoint_offset) or PID deadband, 10-bit ADC value
+    uint16_t setpoint_offset;
+    // motor speed up or down out of the hysteresis (PID output limit), steps/s
+    int16_t speed;
+    // setpoint definition, see above
+    uint16_t setpoint_min_ticks;
+    uint16_t setpoint_max_ticks;
+    uint16_t setpoint_tolerance;
+#ifdef PID_REGULATION
+    uint16_t kp;
+    uint16_t ki;
+    uint16_t kd;
+#endif
+#ifdef SLOPE_CORRECTION
+    // arc voltage change per step (positive is up), 1/256 FILTER_BITS-bit units,
+    // 0 - unknown (constant speed then)
+    uint16_t slope;
+#endif
+} RegulatorSettings;
+
+enum RegulatorResult {
+    REGULATOR_DEFINING_SETPOINT,  // no decision yet
+    REGULATOR_SETPOINT_DEFINED,  // just now, the command is given as well
+    REGULATOR_COMMAND,
+    REGULATOR_MOVE  // command is the steps to move (SLOPE_CORRECTION)
+};
+
+
+extern uint16_t feedback;  // the last sample, 10-bit ADC value
+// filtered value, FILTER_BITS-bit (as well as the setpoint)
+extern uint16_t feedback_avrg;
+extern uint16_t setpoint;
+extern bool setpoint_defined;
+extern uint8_t setpoint_confidence;  // %
+
+
+// new regulation session: forget the filter history and define the setpoint anew
+void regulator_start(const RegulatorSettings *settings);
+void regulator_sample(uint16_t sample);
+// Decision for this control tick: motor speed in steps/s (positive is up), in
+// the default mode it is ±speed or 0 (stop right away)
+uint8_t regulator_tick(int16_t *command);
+// end of the session, the last setpoint is kept (idle screen shows it)
+void regulator_stop(void);
+#ifdef SLOPE_CORRECTION
+// slope measured during the session
+void regulator_set_slope(uint16_t slope);
+// the correction move has been made and settled, the error is confirmed anew
+void regulator_move_done(void);
+#endif
+#ifdef ANTI_DIVE
+// Every sample as soon as it's measured, returns true when the height has been
+// locked just now (stop the motor right away). Commands are 0 while it's locked
+bool regulator_watch(uint16_t sample);
+// external lock, kept till released (sessions don't reset it)
+void regulator_hold(bool hold);
+bool regulator_locked(void);
+#endif
+
+
+
+#endif /* REGULATOR_H_ */
@@ -0,0 +1,77 @@
+#include <RunningStats.h>
+
+
+static uint16_t isqrt(uint32_t x) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL<<30;
+
+    while (bit > x)
+        bit >>= 2;
+    while (bit) {
+        if (x >= root+bit) {
+            x -= root+bit;
+            root = (root>>1) + bit;
+        }
+        else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+
+void stats_reset(RunningStats *stats) {
+    stats->count = 0;
+    stats->mean = 0;
+    stats->m2 = 0;
+}
+
+
+void stats_add(RunningStats *stats, uint16_t value) {
+    int32_t x = (int32_t)value<<STATS_FRAC_BITS;
+    int32_t delta = x - stats->mean;
+
+    stats->count++;
+    stats->mean += delta/stats->count;
+
+    // delta*(x-mean) is never negative and takes up to 2*(16+STATS_FRAC_BITS) bits
+    uint64_t m2_delta = (int64_t)delta*(x-stats->mean);
+    if (m2_delta > 0xFFFFFFFFUL - stats->m2)
+        stats->m2 = 0xFFFFFFFFUL;
+    else
+        stats->m2 += m2_delta;
+}
+
+
+uint16_t stats_mean(const RunningStats *stats) {
+    return (stats->mean + (1<<(STATS_FRAC_BITS-1))) >> STATS_FRAC_BITS;
+}
+
+
+uint32_t stats_variance(const RunningStats *stats) {
+    if (stats->count < 2)
+        return 0xFFFFFFFFUL;
+    return stats->m2/(stats->count-1);
+}
+
+
+// variance/count <= tolerance^2
+bool stats_converged(const RunningStats *stats, uint16_t tolerance) {
+    if (stats->count < 2)
+        return false;
+    uint32_t limit = ((uint32_t)tolerance*tolerance<<(2*STATS_FRAC_BITS)) * stats->count;
+    return stats_variance(stats) <= limit;
+}
+
+
+uint8_t stats_confidence(const RunningStats *stats, uint16_t tolerance) {
+    if (stats->count < 2)
+        return 0;
+    // standard error of the mean with STATS_FRAC_BITS fractional bits
+    uint16_t error = isqrt(stats_variance(stats)/stats->count);
+    uint32_t tolerance_fixed = (uint32_t)tolerance<<STATS_FRAC_BITS;
+    if (error <= tolerance_fixed)
+        return 100;
+    return tolerance_fixed*100/error;
+}
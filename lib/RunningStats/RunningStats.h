@@ -0,0 +1,41 @@
+#ifndef RUNNINGSTATS_H_
+#define RUNNINGSTATS_H_
+
+
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*
+ *  Running mean and variance of a stream of unsigned 16-bit values (Welford's
+ *  algorithm) in fixed point. Mean is kept with STATS_FRAC_BITS fractional bits,
+ *  sum of squared deviations with twice as many. Products of the deviations
+ *  take up to 2*(16+STATS_FRAC_BITS) bits so they are calculated in 64 bits
+ */
+#define STATS_FRAC_BITS 4
+
+
+typedef struct {
+    uint16_t count;
+    int32_t mean;
+    // sum of squared deviations from the mean, saturates
+    uint32_t m2;
+} RunningStats;
+
+
+void stats_reset(RunningStats *stats);
+void stats_add(RunningStats *stats, uint16_t value);
+// rounded to the integer
+uint16_t stats_mean(const RunningStats *stats);
+// sample variance with 2*STATS_FRAC_BITS fractional bits
+uint32_t stats_variance(const RunningStats *stats);
+// true if the standard error of the mean is not greater than the tolerance
+bool stats_converged(const RunningStats *stats, uint16_t tolerance);
+// How sure we are in the mean, 0-100%: 100% when the standard error of the mean
+// is within the tolerance and proportionally less when it is bigger
+uint8_t stats_confidence(const RunningStats *stats, uint16_t tolerance);
+
+
+
+#endif /* RUNNINGSTATS_H_ */
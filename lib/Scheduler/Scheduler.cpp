@@ -0,0 +1,110 @@
+#include <Scheduler.h>
+
+
+#define EVENT_QUEUE_MASK (EVENT_QUEUE_SIZE-1)
+#if (EVENT_QUEUE_SIZE & EVENT_QUEUE_MASK) || (EVENT_QUEUE_SIZE > 128)
+    #error "EVENT_QUEUE_SIZE must be a power of 2 not greater than 128"
+#endif
+
+// events can be posted both from ISRs and from the main loop
+static volatile uint8_t event_queue[EVENT_QUEUE_SIZE];
+static volatile uint8_t event_head = 0;
+static volatile uint8_t event_tail = 0;
+
+typedef struct {
+    uint16_t ticks_left;  // 0 - timer is not active
+    uint16_t period;  // 0 - one-shot timer
+    uint8_t event;
+} SoftTimer;
+static volatile SoftTimer timers[SCHEDULER_TIMERS];
+
+
+// Events are dropped if the queue is full so keep it large enough
+void event_post(uint8_t event) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if ((uint8_t)(event_head-event_tail) < EVENT_QUEUE_SIZE) {
+            event_queue[event_head & EVENT_QUEUE_MASK] = event;
+            event_head++;
+        }
+    }
+}
+
+
+// Take the oldest event or NO_EVENT if there are none
+uint8_t event_get(void) {
+    uint8_t event = NO_EVENT;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (event_head != event_tail) {
+            event = event_queue[event_tail & EVENT_QUEUE_MASK];
+            event_tail++;
+        }
+    }
+    return event;
+}
+
+
+// Post the event after given number of ticks (at least 1). Restarts the timer
+// if it is already running
+void timer_start(uint8_t timer, uint16_t ticks, uint8_t event) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        timers[timer].ticks_left = ticks ? ticks : 1;
+        timers[timer].period = 0;
+        timers[timer].event = event;
+    }
+}
+
+
+// Post the event every given number of ticks
+void timer_start_periodic(uint8_t timer, uint16_t ticks, uint8_t event) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        timers[timer].ticks_left = ticks ? ticks : 1;
+        timers[timer].period = ticks ? ticks : 1;
+        timers[timer].event = event;
+    }
+}
+
+
+void timer_stop(uint8_t timer) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        timers[timer].ticks_left = 0;
+    }
+}
+
+
+bool timer_active(uint8_t timer) {
+    bool active;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        active = timers[timer].ticks_left != 0;
+    }
+    return active;
+}
+
+
+// Call from the periodic interrupt
+void scheduler_tick(void) {
+    for (uint8_t i=0; i<SCHEDULER_TIMERS; i++) {
+        if (timers[i].ticks_left && !--timers[i].ticks_left) {
+            event_post(timers[i].event);
+            timers[i].ticks_left = timers[i].period;
+        }
+    }
+}
+
+
+/*
+ *  Sleep (idle mode, all timers and ADC keep running) if there are no events. Any
+ *  interrupt wakes us up. Interrupts are enabled right before the sleep instruction
+ *  so an event posted after the check can't be missed (SEI always executes the
+ *  next instruction before any pending interrupt)
+ */
+void scheduler_sleep(void) {
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    if (event_head == event_tail) {
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+    }
+    sei();
+}
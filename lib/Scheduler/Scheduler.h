@@ -0,0 +1,40 @@
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
+#include <stdbool.h>
+
+
+/*
+ *  Tiny cooperative scheduler. Interrupt handlers only post events (small numbers
+ *  defined by the application, 0 is reserved for "no event") and the main loop
+ *  takes them one by one and does the actual work. Software timers post their
+ *  event when they expire. They are counted in ticks of scheduler_tick() which
+ *  the application calls from some periodic interrupt. When there is nothing to do
+ *  the main loop sleeps till the next interrupt
+ */
+#define NO_EVENT 0
+// must be a power of 2
+#define EVENT_QUEUE_SIZE 16
+#define SCHEDULER_TIMERS 8
+
+
+void event_post(uint8_t event);
+uint8_t event_get(void);
+
+void timer_start(uint8_t timer, uint16_t ticks, uint8_t event);
+void timer_start_periodic(uint8_t timer, uint16_t ticks, uint8_t event);
+void timer_stop(uint8_t timer);
+bool timer_active(uint8_t timer);
+
+void scheduler_tick(void);
+void scheduler_sleep(void);
+
+
+
+#endif /* SCHEDULER_H_ */
@@ -0,0 +1,91 @@
+#include <Settings.h>
+#include <string.h>
+#include <util/crc16.h>
+
+
+// Empty (0xFF) and zeroed slots are never valid
+#define SETTINGS_MAGIC 0x5A
+#define CRC_INIT 0xFFFF
+// the newest record is found by the sequence numbers difference
+static_assert(SETTINGS_JOURNAL_SLOTS >= 2 && SETTINGS_JOURNAL_SLOTS < 128,
+              "SETTINGS_JOURNAL_SIZE must take from 2 to 127 records");
+// the defaults and the rest of the application need some room too
+static_assert(SETTINGS_JOURNAL_SIZE + sizeof(Settings) <= E2END+1,
+              "SETTINGS_JOURNAL_SIZE doesn't fit into EEPROM");
+
+Settings settings;
+Profile *current_profile = &settings.profiles[0];
+
+static uint8_t EEMEM journal[SETTINGS_JOURNAL_SLOTS][SETTINGS_RECORD_SIZE];
+// slot of the newest record, SETTINGS_JOURNAL_SLOTS - there are no records
+static uint8_t newest = SETTINGS_JOURNAL_SLOTS;
+static uint8_t newest_sequence = 0;
+
+
+static uint16_t record_crc(const uint8_t *record) {
+    uint16_t crc = CRC_INIT;
+    for (uint8_t i = 0; i < SETTINGS_RECORD_SIZE-2; i++)
+        crc = _crc_xmodem_update(crc, record[i]);
+    return crc;
+}
+
+
+static bool read_record(uint8_t slot, uint8_t *record) {
+    eeprom_read_block(record, journal[slot], SETTINGS_RECORD_SIZE);
+    uint16_t crc = record[SETTINGS_RECORD_SIZE-2] | (uint16_t)record[SETTINGS_RECORD_SIZE-1]<<8;
+    return record[0] == SETTINGS_MAGIC && crc == record_crc(record);
+}
+
+
+void settings_load(void) {
+    uint8_t record[SETTINGS_RECORD_SIZE];
+
+    newest = SETTINGS_JOURNAL_SLOTS;
+    for (uint8_t slot = 0; slot < SETTINGS_JOURNAL_SLOTS; slot++) {
+        if ( !read_record(slot, record) ) continue;
+        if ( newest == SETTINGS_JOURNAL_SLOTS || (int8_t)(record[1]-newest_sequence) > 0 ) {
+            newest = slot;
+            newest_sequence = record[1];
+        }
+    }
+
+    if (newest == SETTINGS_JOURNAL_SLOTS) {
+        eeprom_read_block(&settings, &settings_defaults, sizeof(Settings));
+    }
+    else {
+        read_record(newest, record);
+        memcpy(&settings, &record[2], sizeof(Settings));
+    }
+    settings_select(settings.profile);
+}
+
+
+void settings_save(void) {
+    uint8_t record[SETTINGS_RECORD_SIZE];
+
+    if (newest == SETTINGS_JOURNAL_SLOTS)
+        eeprom_read_block(&record[2], &settings_defaults, sizeof(Settings));
+    else
+        eeprom_read_block(record, journal[newest], SETTINGS_RECORD_SIZE);
+    if ( memcmp(&record[2], &settings, sizeof(Settings)) == 0 )
+        return;
+
+    newest = newest < SETTINGS_JOURNAL_SLOTS-1 ? newest+1 : 0;
+    newest_sequence++;
+    record[0] = SETTINGS_MAGIC;
+    record[1] = newest_sequence;
+    memcpy(&record[2], &settings, sizeof(Settings));
+    uint16_t crc = record_crc(record);
+    record[SETTINGS_RECORD_SIZE-2] = crc;
+    record[SETTINGS_RECORD_SIZE-1] = crc>>8;
+    // unchanged bytes of the slot are not written
+    eeprom_update_block(record, journal[newest], SETTINGS_RECORD_SIZE);
+}
+
+
+void settings_select(uint8_t profile) {
+    if (profile >= PROFILES)
+        profile = 0;
+    settings.profile = profile;
+    current_profile = &settings.profiles[profile];
+}
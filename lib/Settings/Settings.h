@@ -0,0 +1,69 @@
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <stdint.h>
+#include <stdbool.h>
+// PID_REGULATION
+#include <Regulator.h>
+
+
+/*
+ *  Settings of the device: bypass mode and PROFILES profiles of the cutting
+ *  parameters (e.g. material and thickness), one of them is active. They live
+ *  in RAM so everybody reads them right there and a profile is switched at once.
+ *  EEPROM keeps a journal of SETTINGS_JOURNAL_SLOTS records: every save writes
+ *  the whole settings to the next slot in turn with a sequence number and CRC,
+ *  so each cell is written once per SETTINGS_JOURNAL_SLOTS saves. At power-up the
+ *  newest valid record is loaded, a save broken by the power loss only loses
+ *  itself. Without any valid record (EEPROM has just been flashed) the defaults
+ *  are loaded (settings_defaults in EEPROM, given by the application, the tuner
+ *  writes its results there)
+ */
+#define PROFILES 4
+// bytes of EEPROM for the journal
+#define SETTINGS_JOURNAL_SIZE 768
+
+
+// All the fields are 16-bit so the layout is the same on AVR and on the host
+// (the tuner writes the defaults)
+typedef struct {
+    uint16_t cutting_height;  // steps
+    uint16_t setpoint_offset;  // 10-bit ADC value
+    uint16_t pierce_time;  // in the application units
+#ifdef PID_REGULATION
+    uint16_t kp;
+    uint16_t ki;
+    uint16_t kd;
+#endif
+} Profile;
+
+typedef struct {
+    uint8_t profile;  // active one
+    uint8_t bypass;
+    Profile profiles[PROFILES];
+} Settings;
+
+// magic, sequence number, settings, CRC
+#define SETTINGS_RECORD_SIZE (2+sizeof(Settings)+2)
+#define SETTINGS_JOURNAL_SLOTS (SETTINGS_JOURNAL_SIZE/SETTINGS_RECORD_SIZE)
+
+
+extern Settings settings;
+extern Profile *current_profile;  // active one
+extern Settings EEMEM settings_defaults;  // defined by the application
+
+
+// the newest record of the journal (or the defaults)
+void settings_load(void);
+// Append a record if the settings differ from the newest one. It takes a few
+// ms per byte so call it when the time isn't critical (e.g. settings menu exit)
+void settings_save(void);
+void settings_select(uint8_t profile);
+
+
+
+#endif /* SETTINGS_H_ */
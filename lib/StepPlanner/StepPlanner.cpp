@@ -0,0 +1,264 @@
+#include <StepPlanner.h>
+
+
+/*
+ *  Compile-time ramp generation. Each step lasts 1/v seconds so during it
+ *  the speed grows by a/v and the acceleration by jerk/v
+ */
+struct RampState {
+    float speed;
+    float acceleration;
+    constexpr RampState(float speed, float acceleration) :
+        speed(speed), acceleration(acceleration) {}
+};
+
+constexpr float ramp_min(float a, float b) {
+    return (a < b) ? a : b;
+}
+
+constexpr RampState ramp_next(RampState s) {
+    return RampState( ramp_min(s.speed + s.acceleration/s.speed, PLANNER_MAX_SPEED),
+                      ramp_min(s.acceleration + (float)PLANNER_JERK/s.speed, PLANNER_ACCELERATION) );
+}
+
+constexpr RampState ramp_state(uint16_t level) {
+    return (level == 0) ? RampState(PLANNER_START_SPEED, 0) : ramp_next(ramp_state(level-1));
+}
+
+// first level at which the maximal speed is reached
+constexpr uint8_t ramp_top(RampState s, uint16_t level) {
+    return (level == 255 || s.speed >= PLANNER_MAX_SPEED) ? level : ramp_top(ramp_next(s), level+1);
+}
+
+constexpr uint16_t ramp_speed(uint16_t level) {
+    return ramp_state(level).speed + 0.5f;
+}
+
+// Timer2 settings for the period of the given speed: prescaler bits in the high byte
+// and OCR2A in the low one. The smallest prescaler that fits 8-bit period is taken
+constexpr uint16_t ramp_timer_ticks(float ticks) {
+    return (ticks <= 8.0f*256)   ? ( ((1<<CS21)<<8)             | (uint8_t)(ticks/8 - 0.5f) ) :
+           (ticks <= 32.0f*256)  ? ( (((1<<CS21)|(1<<CS20))<<8) | (uint8_t)(ticks/32 - 0.5f) ) :
+           (ticks <= 64.0f*256)  ? ( ((1<<CS22)<<8)             | (uint8_t)(ticks/64 - 0.5f) ) :
+           (ticks <= 128.0f*256) ? ( (((1<<CS22)|(1<<CS20))<<8) | (uint8_t)(ticks/128 - 0.5f) ) :
+           (ticks <= 256.0f*256) ? ( (((1<<CS22)|(1<<CS21))<<8) | (uint8_t)(ticks/256 - 0.5f) ) :
+                                   ( (((1<<CS22)|(1<<CS21)|(1<<CS20))<<8) | (uint8_t)(ticks/1024 - 0.5f) );
+}
+
+constexpr uint16_t ramp_timer(uint16_t level) {
+    return ramp_timer_ticks((float)F_CPU/ramp_state(level).speed);
+}
+
+static_assert(PLANNER_START_SPEED > F_CPU/1024/256, "PLANNER_START_SPEED is too low for Timer2");
+static_assert(PLANNER_START_SPEED <= PLANNER_MAX_SPEED, "PLANNER_START_SPEED is above PLANNER_MAX_SPEED");
+static_assert(ramp_state(255).speed >= PLANNER_MAX_SPEED,
+              "PLANNER_MAX_SPEED can't be reached in 256 steps, increase PLANNER_ACCELERATION");
+
+#define RAMP_TOP ramp_top(ramp_state(0), 0)
+
+#define RAMP_4(f, n) f(n), f(n+1), f(n+2), f(n+3)
+#define RAMP_16(f, n) RAMP_4(f, n), RAMP_4(f, n+4), RAMP_4(f, n+8), RAMP_4(f, n+12)
+#define RAMP_64(f, n) RAMP_16(f, n), RAMP_16(f, n+16), RAMP_16(f, n+32), RAMP_16(f, n+48)
+#define RAMP_256(f) RAMP_64(f, 0), RAMP_64(f, 64), RAMP_64(f, 128), RAMP_64(f, 192)
+
+static const uint16_t ramp_speed_table[256] PROGMEM = { RAMP_256(ramp_speed) };
+static const uint16_t ramp_timer_table[256] PROGMEM = { RAMP_256(ramp_timer) };
+
+
+/*
+ *  Planner state. Direction is the one of the next step: 1 - up, -1 - down,
+ *  0 - motor is standing. In positioning mode target direction and level are
+ *  recalculated on each step from the distance left
+ */
+static volatile uint8_t level = 0;
+static volatile int8_t direction = 0;
+static volatile uint8_t target_level = 0;
+static volatile int8_t target_direction = 0;
+static volatile bool positioning = false;
+static volatile uint8_t cruise_level = 0;
+static volatile int32_t target_position = 0;
+// absolute position in steps (0 is where we were at power-up), positive is up
+static volatile int32_t position = 0;
+
+
+static void set_timer(uint8_t ramp_level) {
+    uint16_t settings = pgm_read_word(&ramp_timer_table[ramp_level]);
+    OCR2A = settings & 0xFF;
+    // middle of the period, for drivers that form STEP pulses by hardware (OC2B)
+    OCR2B = (settings & 0xFF) >> 1;
+    TCCR2B = (TCCR2B & ~((1<<CS22)|(1<<CS21)|(1<<CS20))) | (settings >> 8);
+    // In CTC mode compare register is not buffered: counter may have already passed
+    // the new value and would run through the whole 8-bit range before the next step.
+    // PWM modes (WGM22 set) load new values only at BOTTOM so it's not a problem there
+    if ( !(TCCR2B & (1<<WGM22)) && (TCNT2 >= OCR2A) )
+        TCNT2 = 0;
+}
+
+
+// the highest level whose speed doesn't exceed the given one
+static uint8_t level_for_speed(uint16_t speed) {
+    uint16_t low = 0, high = RAMP_TOP+1;
+    while (low < high) {
+        uint16_t middle = (low+high)/2;
+        if (pgm_read_word(&ramp_speed_table[middle]) > speed)
+            high = middle;
+        else
+            low = middle+1;
+    }
+    return (low == 0) ? 0 : low-1;
+}
+
+
+void planner_init(void) {
+    // CTC mode, timer is stopped until the first movement
+    TCCR2A = (1<<WGM21);
+    TCCR2B = 0;
+}
+
+
+// Start from standstill if there is somewhere to go. Returns direction of the first step
+static int8_t start(void) {
+    if ( (direction == 0) && (target_direction != 0) ) {
+        direction = target_direction;
+        level = 0;
+        set_timer(level);
+        TCNT2 = 0;
+        return direction;
+    }
+    return 0;
+}
+
+
+// Choose the target in positioning mode: go towards the target position and slow
+// down in time to make the last step at the lowest level (one level per step)
+static void update_position_target(void) {
+    int32_t distance = target_position-position;
+
+    if (distance > 0) {
+        target_direction = 1;
+    }
+    else if (distance < 0) {
+        target_direction = -1;
+        distance = -distance;
+    }
+    else {
+        target_direction = 0;
+    }
+
+    if (distance > cruise_level)
+        target_level = cruise_level;
+    else
+        target_level = (distance > 0) ? distance-1 : 0;
+}
+
+
+/*
+ *  Set the new desired speed (±steps per second, positive is up, 0 - smooth stop).
+ *  Can be called at any time, current movement is smoothly retargeted (including
+ *  the reverse). Returns direction of the first step if the motor was standing and
+ *  should be started now (planner has already prepared the timer for it), 0 otherwise
+ */
+int8_t planner_set_speed(int16_t speed) {
+    int8_t start_direction;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        positioning = false;
+
+        if (speed > 0) {
+            target_direction = 1;
+        }
+        else if (speed < 0) {
+            target_direction = -1;
+            speed = -speed;
+        }
+        else {
+            target_direction = 0;
+        }
+        target_level = level_for_speed(speed);
+
+        start_direction = start();
+    }
+
+    return start_direction;
+}
+
+
+/*
+ *  Go to the absolute position (steps) cruising not faster than the given speed.
+ *  Like planner_set_speed() can retarget the current movement and returns the
+ *  direction of the first step if the motor should be started
+ */
+int8_t planner_move_to(int32_t new_position, uint16_t speed) {
+    int8_t start_direction;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        positioning = true;
+        target_position = new_position;
+        cruise_level = level_for_speed(speed);
+        update_position_target();
+
+        start_direction = start();
+    }
+
+    return start_direction;
+}
+
+
+/*
+ *  Call from the Timer2 ISR right after the step. Chooses the period before the
+ *  next step and returns its direction (0 - stop, disable the interrupt)
+ */
+int8_t planner_step(void) {
+    // the step that has just been made
+    position += direction;
+
+    if (positioning)
+        update_position_target();
+
+    if (direction != target_direction) {
+        // reverse or stop: decelerate to standstill first
+        if (level == 0) {
+            direction = target_direction;
+            if (direction == 0)
+                return 0;
+        }
+        else {
+            level--;
+        }
+    }
+    else if (level < target_level) {
+        level++;
+    }
+    else if (level > target_level) {
+        level--;
+    }
+
+    set_timer(level);
+    return direction;
+}
+
+
+// Immediate stop (without deceleration)
+void planner_stop(void) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        direction = 0;
+        target_direction = 0;
+        positioning = false;
+        level = 0;
+    }
+}
+
+
+// true while the motor is moving (including the deceleration)
+bool planner_busy(void) {
+    return direction != 0;
+}
+
+
+int32_t planner_position(void) {
+    int32_t current_position;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        current_position = position;
+    }
+    return current_position;
+}
@@ -0,0 +1,44 @@
+#ifndef STEPPLANNER_H_
+#define STEPPLANNER_H_
+
+
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <util/atomic.h>
+#include <stdbool.h>
+
+
+/*
+ *  Motion profile of Z axis. The motor starts (and stops) instantly at
+ *  PLANNER_START_SPEED, then its acceleration grows with PLANNER_JERK rate
+ *  up to PLANNER_ACCELERATION until the desired speed (not more than
+ *  PLANNER_MAX_SPEED) is reached. Deceleration follows the same curve backwards.
+ *  All units are steps and seconds
+ */
+#define PLANNER_START_SPEED 250
+#define PLANNER_MAX_SPEED 3000
+#define PLANNER_ACCELERATION 20000
+#define PLANNER_JERK 2000000
+
+
+/*
+ *  Timer2 is the time base of all motor drivers: one compare match (CTC mode) is
+ *  one step. The whole ramp is precomputed at compile time as 256 "levels": level n
+ *  is the speed reached after n steps of accelerating from standstill. Each step
+ *  moves one level up or down so the step ISR only has to look up the table
+ *  (ready prescaler and OCR2A values) - no math at all. Planner also counts the
+ *  steps so the absolute position of Z axis is always known, and the motor can go
+ *  either at the given speed or to the given position
+ */
+void planner_init(void);
+int8_t planner_set_speed(int16_t speed);
+int8_t planner_move_to(int32_t new_position, uint16_t speed);
+int8_t planner_step(void);
+void planner_stop(void);
+bool planner_busy(void);
+int32_t planner_position(void);
+
+
+
+#endif /* STEPPLANNER_H_ */
@@ -0,0 +1,115 @@
+#include <Telemetry.h>
+
+#ifdef TELEMETRY
+
+
+#define UBRR_VALUE ((F_CPU/8 + TELEMETRY_BAUD/2)/TELEMETRY_BAUD - 1)
+
+// offsets in the frame
+#define LENGTH_OFFSET 2
+#define SEQUENCE_OFFSET 3
+#define SAMPLES_NUM_OFFSET (TELEMETRY_HEADER_SIZE+1)
+#define SAMPLES_OFFSET (TELEMETRY_HEADER_SIZE+TELEMETRY_PAYLOAD_FIXED_SIZE)
+
+/*
+ *  Double buffering: frame is built in buffers[fill] while buffers[fill^1] is
+ *  being sent. Both sides run in interrupts that don't nest so no locking
+ */
+static uint8_t buffers[2][TELEMETRY_FRAME_SIZE];
+static uint8_t fill = 0;
+static uint8_t samples_num = 0;
+static uint8_t sequence = 0;
+static volatile uint16_t dropped = 0;
+// bytes of buffers[fill^1] left to send and the next one, 0 when the UART is idle
+static volatile uint8_t send_left = 0;
+static const uint8_t *volatile send_ptr;
+
+
+void telemetry_init(void) {
+    UBRR0 = UBRR_VALUE;
+    UCSR0A = (1<<U2X0);
+    // TX only, 8N1
+    UCSR0C = (1<<UCSZ01)|(1<<UCSZ00);
+    UCSR0B = (1<<TXEN0);
+}
+
+
+void telemetry_sample(uint16_t sample) {
+    if (samples_num == TELEMETRY_MAX_SAMPLES)
+        return;
+    uint8_t *p = &buffers[fill][SAMPLES_OFFSET + 2*samples_num];
+    p[0] = sample;
+    p[1] = sample>>8;
+    samples_num++;
+}
+
+
+static uint8_t *put16(uint8_t *p, uint16_t value) {
+    *p++ = value;
+    *p++ = value>>8;
+    return p;
+}
+
+
+void telemetry_frame(uint8_t state, uint16_t feedback, uint16_t setpoint,
+                     int32_t position, int16_t command) {
+    uint8_t *frame = buffers[fill];
+    uint8_t length = TELEMETRY_PAYLOAD_FIXED_SIZE + 2*samples_num;
+    samples_num = 0;
+
+    // previous frame is still on the way
+    if (send_left) {
+        sequence++;
+        dropped++;
+        return;
+    }
+
+    frame[0] = TELEMETRY_SYNC1;
+    frame[1] = TELEMETRY_SYNC2;
+    frame[LENGTH_OFFSET] = length;
+    frame[SEQUENCE_OFFSET] = sequence++;
+    uint8_t *p = &frame[TELEMETRY_HEADER_SIZE];
+    *p++ = state;
+    *p++ = (length-TELEMETRY_PAYLOAD_FIXED_SIZE)/2;
+    p = put16(p, dropped);
+    p = put16(p, feedback);
+    p = put16(p, setpoint);
+    p = put16(p, position);
+    p = put16(p, (uint32_t)position>>16);
+    put16(p, command);
+
+    uint16_t crc = 0;
+    for (uint8_t i = LENGTH_OFFSET; i < TELEMETRY_HEADER_SIZE+length; i++)
+        crc = _crc_xmodem_update(crc, frame[i]);
+    put16(&frame[TELEMETRY_HEADER_SIZE+length], crc);
+
+    // hand the frame over to the UART and start filling the other buffer
+    send_ptr = frame;
+    send_left = TELEMETRY_HEADER_SIZE + length + 2;
+    fill ^= 1;
+    UCSR0B |= (1<<UDRIE0);
+}
+
+
+uint16_t telemetry_dropped(void) {
+    uint16_t value;
+    uint8_t sreg = SREG;
+    cli();
+    value = dropped;
+    SREG = sreg;
+    return value;
+}
+
+
+ISR (USART_UDRE_vect) {
+    PROFILE_ISR_BEGIN(PROFILE_TELEMETRY_ISR);
+
+    UDR0 = *send_ptr++;
+    if (--send_left == 0)
+        UCSR0B &= ~(1<<UDRIE0);
+
+    PROFILE_ISR_END(PROFILE_TELEMETRY_ISR);
+}
+
+
+#endif
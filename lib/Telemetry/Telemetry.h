@@ -0,0 +1,73 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+#include <stdbool.h>
+#include <Profiler.h>
+
+
+/*
+ *  Uncomment to stream the control loop out of the UART TX pin (PD1, Arduino 1)
+ *  for the post-mortem analysis of the cuts (host/telemetry decodes it). PD1 is
+ *  LCD RS line by default so define LCD_RS_ON_PC4 in LCD.h too.
+ *
+ *  One frame is sent per control tick while the regulation runs. It carries all
+ *  raw arc voltage samples of the tick along with the filtered value, the
+ *  setpoint, the motor position and command. Frame is built in one buffer while
+ *  the other one is being sent by UDRE interrupt, byte by byte. If the previous
+ *  frame still isn't sent when the next one is complete, the new one is dropped
+ *  and counted: nobody ever waits for the UART
+ */
+// #define TELEMETRY
+
+#define TELEMETRY_BAUD 1000000UL  // exact at 16MHz (U2X)
+// samples above that in one tick are not sent (but still processed)
+#define TELEMETRY_MAX_SAMPLES 48
+
+/*
+ *  Frame (little endian):
+ *    0xA5 0x5A - sync
+ *    uint8 payload length
+ *    uint8 sequence number (counts dropped frames as well, gaps show losses)
+ *    payload:
+ *      uint8 state
+ *      uint8 number of samples
+ *      uint16 frames dropped so far
+ *      uint16 filtered feedback, FILTER_BITS-bit
+ *      uint16 setpoint, FILTER_BITS-bit
+ *      int32 motor position, steps
+ *      int16 motor command, steps/s (positive is up)
+ *      uint16 samples[number of samples], 10-bit
+ *    uint16 CRC-16/XMODEM of the length, sequence number and payload
+ */
+#define TELEMETRY_SYNC1 0xA5
+#define TELEMETRY_SYNC2 0x5A
+#define TELEMETRY_HEADER_SIZE 4
+#define TELEMETRY_PAYLOAD_FIXED_SIZE 14
+#define TELEMETRY_FRAME_SIZE (TELEMETRY_HEADER_SIZE + TELEMETRY_PAYLOAD_FIXED_SIZE + \
+                              2*TELEMETRY_MAX_SAMPLES + 2)
+#if TELEMETRY_PAYLOAD_FIXED_SIZE + 2*TELEMETRY_MAX_SAMPLES > 255
+    #error "TELEMETRY_MAX_SAMPLES is too big for 8-bit frame length"
+#endif
+
+
+#ifdef TELEMETRY
+
+void telemetry_init(void);
+// raw ADC sample of the current frame
+void telemetry_sample(uint16_t sample);
+// Complete the current frame and send it (if the UART has managed the previous one).
+// Call it from the same interrupt as telemetry_sample()
+void telemetry_frame(uint8_t state, uint16_t feedback, uint16_t setpoint,
+                     int32_t position, int16_t command);
+uint16_t telemetry_dropped(void);
+
+#endif
+
+
+
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,92 @@
+#include <Units.h>
+
+
+#if ARC_DIVIDER_RATIO < 1000 || ARC_DIVIDER_RATIO > ARC_DIVIDER_RATIO_MAX
+    #error "ARC_DIVIDER_RATIO is out of range"
+#endif
+
+#define ADC_MAX_VALUE 1023
+
+uint32_t arc_divider_ratio = ARC_DIVIDER_RATIO;
+
+
+// all conversions are rounded to the nearest value
+uint16_t adc_to_mv(uint16_t adc) {
+    return ((uint32_t)adc*ADC_REFERENCE_MILLIVOLTS + ADC_MAX_VALUE/2) / ADC_MAX_VALUE;
+}
+
+
+uint16_t mv_to_adc(uint16_t mv) {
+    return ((uint32_t)mv*ADC_MAX_VALUE + ADC_REFERENCE_MILLIVOLTS/2) / ADC_REFERENCE_MILLIVOLTS;
+}
+
+
+uint16_t adc_to_arc_voltage(uint16_t adc) {
+    // mV*ratio is at most 5000*131070 so it fits in 32 bits
+    return ((uint32_t)adc_to_mv(adc)*arc_divider_ratio + 5000) / 10000;
+}
+
+
+uint16_t arc_voltage_to_adc(uint16_t arc_voltage) {
+    return mv_to_adc( ((uint32_t)arc_voltage*10000 + arc_divider_ratio/2) / arc_divider_ratio );
+}
+
+
+void arc_divider_calibrate(uint16_t adc, uint16_t arc_voltage) {
+    uint16_t mv = adc_to_mv(adc);
+    if (mv == 0)
+        return;
+
+    uint32_t ratio = ((uint32_t)arc_voltage*10000 + mv/2) / mv;
+    if (ratio < 1000)
+        ratio = 1000;
+    else if (ratio > ARC_DIVIDER_RATIO_MAX)
+        ratio = ARC_DIVIDER_RATIO_MAX;
+    arc_divider_ratio = ratio;
+}
+
+
+int32_t steps_to_um(int32_t steps) {
+    return steps*1000/STEPS_PER_MM;
+}
+
+
+int32_t um_to_steps(int32_t um) {
+    return um*STEPS_PER_MM/1000;
+}
+
+
+char *format_fixed(char *buf, int32_t value, uint8_t width, uint8_t decimals) {
+    // longest 32-bit number with the sign and the point
+    char digits[12];
+    uint8_t len = 0;
+    bool negative = value < 0;
+    uint32_t magnitude = negative ? -(uint32_t)value : value;
+
+    // digits in the reverse order, at least one before the point
+    do {
+        if (len == decimals && decimals)
+            digits[len++] = '.';
+        digits[len++] = '0' + magnitude%10;
+        magnitude /= 10;
+    } while (magnitude || len <= decimals);
+    if (negative)
+        digits[len++] = '-';
+
+    while (width > len) {
+        *buf++ = ' ';
+        width--;
+    }
+    while (len)
+        *buf++ = digits[--len];
+    *buf = '\0';
+    return buf;
+}
+
+
+char *format_string(char *buf, const char *str) {
+    while (*str)
+        *buf++ = *str++;
+    *buf = '\0';
+    return buf;
+}
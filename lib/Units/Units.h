@@ -0,0 +1,54 @@
+#ifndef UNITS_H_
+#define UNITS_H_
+
+
+
+#include <stdint.h>
+#include <ADC.h>
+
+
+/*
+ *  Integer conversions between ADC counts, voltages and distances plus a tiny
+ *  formatter of fixed-point numbers. Nothing here needs float math or the float
+ *  version of printf
+ */
+
+/*
+ *  Arc voltage divider: arc volts per volt at the FEEDBACK pin, in 1/1000 units
+ *  (e.g. 50000 for 50:1 divider). 1000 shows the voltage at the pin itself.
+ *  Fine calibration can be done at runtime by arc_divider_calibrate()
+ */
+#define ARC_DIVIDER_RATIO 1000
+// arc voltage is counted in 0.01V units in 16 bits
+#define ARC_DIVIDER_RATIO_MAX (0xFFFFUL*10*1000/ADC_REFERENCE_MILLIVOLTS)
+
+// Mechanics: 200 steps per revolution and 2mm lead screw
+#define STEPS_PER_MM 100
+
+
+extern uint32_t arc_divider_ratio;
+
+// voltage at the ADC pin
+uint16_t adc_to_mv(uint16_t adc);
+uint16_t mv_to_adc(uint16_t mv);
+
+// arc voltage (before the divider) in 0.01V units
+uint16_t adc_to_arc_voltage(uint16_t adc);
+uint16_t arc_voltage_to_adc(uint16_t arc_voltage);
+// set divider ratio so given ADC value corresponds to given (measured by a
+// multimeter) arc voltage (in 0.01V units)
+void arc_divider_calibrate(uint16_t adc, uint16_t arc_voltage);
+
+// distances are in micrometers
+int32_t steps_to_um(int32_t steps);
+int32_t um_to_steps(int32_t um);
+
+// Write value/10^decimals to the buffer right-aligned in the field of given width
+// (0 - no padding). Returns the end of the written string (terminating zero) so
+// calls can be chained
+char *format_fixed(char *buf, int32_t value, uint8_t width, uint8_t decimals);
+char *format_string(char *buf, const char *str);
+
+
+
+#endif /* UNITS_H_ */
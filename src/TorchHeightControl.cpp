@@ -6,50 +6,249 @@
  *  Other settings
  */
 // Lift before cut is measured in steps of stepper motor (0-1023).
-// EEMEM is the default value at the flash time. Actually, not so important
-// because we always can change it at runtime
-uint16_t cutting_height;  // cutting_height
-uint16_t EEMEM cutting_height_EEPROM = 150;
 // Pierce time is measured in ELEMENTARY_DELAYs which in turn is measured in ms
-uint8_t pierce_time;
 #define PIERCE_TIME_ELEMENTARY_DELAY 100  // 100 ms
 #define PIERCE_TIME_MAX_TIME 50  // 50*ELEMENTARY_DELAY = 5s max
-uint8_t EEMEM pierce_time_EEPROM = 20;  // 20*ELEMENTARY_DELAY = 2000ms
-// Flag of the "bypass mode" without regulation. We explicitly use uint8_t type
-// (instead of bool) because AVR's EEPROM driver has function for that
-uint8_t EEMEM bypass_ON_flag_EEPROM = 0;
+// torch is going to the cutting height, pierce timer starts after that
+volatile bool lifting = false;
+
+
+/*
+ *  Touch-off. The torch goes down at MOTOR_MAX_SPEED till PROBE_CLEARANCE above
+ *  the plate height found by the previous touch (absolute position is counted
+ *  by the motor driver, manual up/down included) and only then probes at
+ *  MOTOR_SPEED. The first touch after power-up is the slow one all the way. If
+ *  the plate turns out to be higher than expected the touch stops the motor
+ *  from the full speed, so the torch backs off and touches once more
+ */
+#define PROBE_CLEARANCE 200  // steps
+#define PROBE_BACKOFF_STEPS 50
+// lowest speed: the motor starts and stops at it on the spot
+#define PROBE_RETOUCH_SPEED PLANNER_START_SPEED
+// Uncomment to always back off and touch once more at PROBE_RETOUCH_SPEED, the
+// touch height repeats better at the cost of a fraction of a second
+// #define PROBE_RETOUCH
+// motor position at the last touch
+int32_t touch_position;
+bool touch_position_known = false;
+uint8_t probe_phase;
+// torch is approaching the plate or backing off, control algorithm timer tells
+// when it's done
+volatile bool probe_moving = false;
+
+/*
+ *  Touch during the cut (the torch has dived into the plate). The touch
+ *  interrupt stops the motor and starts the retract right away, regulation
+ *  carries on with the same setpoint when it's done
+ */
+#define DIVE_RETRACT_STEPS 50
+// dives in the current cut, shown on the work screen
+volatile uint8_t dives = 0;
+
+
+/*
+ *  Timings of the main loop routines
+ */
+// software timers tick with control algorithm timer (see MS_TO_TICKS() in Regulator.h)
+// Anti-jitter delay (the level must be stable that long, see Inputs.h). Button is
+// pressed by a human so generally we need some significant delay (also, the
+// button quality is another one factor)
+#define BUTTON_DEBOUNCE_TIME 100  // ms
+// hold the button for about 7.5s to turn ON/OFF bypass mode (valid only from idle mode)
+#define BYPASS_HOLD_TIME 7500  // ms
+// plasm relay cause jitter
+#define PLASM_DEBOUNCE_TIME 20  // ms
+// up and down signals of the CNC
+#define SIGNALS_DEBOUNCE_TIME 8  // ms
+// LCD redrawing (2.5 Hz)
+#define LCD_REFRESH_PERIOD 400  // ms
+// We don't have dedicated routine for LCD processing as we use periodic software timer
+// for this task. So we need to start it every time when we want to constantly
+// refreshing LCD. See lcd_refresh() for more details
+#define LCD_ROUTINE_ON timer_start_periodic(LCD_TIMER, MS_TO_TICKS(LCD_REFRESH_PERIOD), LCD_REFRESH_EVENT)
+#define LCD_ROUTINE_OFF timer_stop(LCD_TIMER)
 
 
 /*
  *  Setpoint settings
  */
-uint16_t setpoint = 0;
-// setpoint will be automatically defined at regulation start
-#define NUM_OF_VALUES_FOR_SETPOINT_DEFINITION 200
-bool setpoint_defined = false;
-// hysteresis for control algorithm (setpoint ± setpoint_offset)
-uint16_t setpoint_offset;
-uint16_t EEMEM setpoint_offset_EEPROM = 20;  // 97mV
-// interval of voltages for specifing setpoint offset in settings menus, Volts
-#define SETPOINT_OFFSET_MIN_SET_VOLTAGE 0.010
-#define SETPOINT_OFFSET_MAX_SET_VOLTAGE 0.200
+// Setpoint is defined automatically at regulation start (see Regulator.h for its
+// timings)
+// hysteresis for control algorithm (setpoint ± setpoint_offset) is set per profile
+// interval of voltages (at the FEEDBACK pin) for specifing setpoint offset in settings menus, mV
+#define SETPOINT_OFFSET_MIN_SET_MILLIVOLTS 10
+#define SETPOINT_OFFSET_MAX_SET_MILLIVOLTS 200
+
+/*
+ *  Settings profiles (see Settings.h), the active one is chosen in the profile
+ *  menu. EEMEM values are the defaults at the flash time (and till the first
+ *  save), not so important because we always can change them at runtime. PID
+ *  gains are in 1/PID_GAIN_SCALE units (see PID.h): output is motor speed
+ *  (steps/s) and input is FILTER_BITS-bit filtered value, so e.g. Kp=320 gives 5
+ *  steps/s for each unit of error (20 steps/s per 10-bit ADC unit). They are set
+ *  in the settings menu in the full 0-1023 ADC range
+ */
+#ifdef PID_REGULATION
+    // cutting_height, setpoint_offset (97mV), pierce_time (ELEMENTARY_DELAYs), kp, ki, kd
+    #define PROFILE_DEFAULTS(pierce_time) {150, 20, pierce_time, 320, 2, 0}
+#else
+    // cutting_height, setpoint_offset (97mV), pierce_time (ELEMENTARY_DELAYs)
+    #define PROFILE_DEFAULTS(pierce_time) {150, 20, pierce_time}
+#endif
+Settings EEMEM settings_defaults = {
+    0,  // profile
+    0,  // bypass
+    {
+        PROFILE_DEFAULTS(20),  // 2000ms
+        PROFILE_DEFAULTS(10),
+        PROFILE_DEFAULTS(40),
+        PROFILE_DEFAULTS(20),
+    }
+};
+// shown in the profile menu (up to LCD_COLS-2 characters)
+const char *const profile_names[PROFILES] = {
+    "general",
+    "thin 3mm",
+    "thick 12mm",
+    "stainless 6mm"
+};
+// Pot pickup: a menu keeps the value till the pot is turned over it, so passing
+// through the menus (e.g. after a profile switch) doesn't change anything
+bool pot_picked_up;
+int8_t pot_side;  // of the pot from the value when the menu was entered
+#ifdef PROFILING
+// diagnostics menu shows one ISR (or the summary) after another
+#define DIAGNOSTICS_PAGE_TIME 2000  // ms
+#define DIAGNOSTICS_PAGES (PROFILE_ISRS+1)
+ProfileSnapshot profile;
+uint8_t diagnostics_refresh_cnt = 0;
+#endif
+
+
+/*
+ *  Control algorithm (see Regulator.h for the rate, the filter and the setpoint
+ *  definition). It runs in the control timer interrupt
+ */
+// last decision of the control algorithm, steps/s (positive is up)
+int16_t motor_command = 0;
+// Fixed part of the regulator settings, the rest is taken from the settings menu
+// values at every regulation start
+RegulatorSettings regulator_settings = {
+    0,  // setpoint_offset
+#ifdef PID_REGULATION
+    MOTOR_MAX_SPEED,
+#else
+    MOTOR_SPEED,
+#endif
+    MS_TO_TICKS(SETPOINT_MIN_TIME),
+    MS_TO_TICKS(SETPOINT_MAX_TIME),
+    SETPOINT_TOLERANCE,
+#ifdef PID_REGULATION
+    0, 0, 0,  // gains
+#endif
+#ifdef SLOPE_CORRECTION
+    0  // slope
+#endif
+};
+
+#ifdef SLOPE_CORRECTION
+/*
+ *  Slope (arc voltage per step) is measured once per job: after the setpoint
+ *  definition of its first cut the torch goes CALIBRATION_STEPS up, the filtered
+ *  value is averaged there and the torch returns. A job lasts till the settings
+ *  are changed (or power-off)
+ */
+#define CALIBRATION_STEPS 50
+// after the move, then averaging
+#define CALIBRATION_SETTLE_TIME 20  // ms
+#define CALIBRATION_TIME 40  // ms
+// arc voltage must rise with the height, less is noise (1/256 FILTER_BITS-bit units per step)
+#define CALIBRATION_MIN_SLOPE 32
+// after each correction move till the filter sees the new height
+#define CORRECTION_SETTLE_TIME 12  // ms
+uint16_t job_slope;
+bool job_slope_known = false;
+uint8_t calibration_cnt;
+uint32_t calibration_sum;
+bool calibration_returning;
+// correction move is on, regulation waits for it and the settling after it
+bool correcting = false;
+uint8_t correction_settle_cnt;
+#endif
 
 
 /*
- *  Signal from arc and control algorithm definitions. Note that we use shared
- *  feedback variables first for setpoint defining and then for main regulation
- *  algorithm itself
+ *  Compile-time check of the timing budget
  */
-uint16_t feedback = 0;  // 10-bit ADC value
-uint16_t feedback_prev = 0;  // previous ADC value
-uint32_t feedback_accum = 0;  // accumulator for averaging
-uint16_t feedback_accum_cnt = 0;  // counter of num of values for averaging
-uint16_t feedback_avrg = 0;
-// counter for manual dividing frequency of algo' timer in its ISR
-uint8_t prescaler_cnt = 0;
-#define PRESCALER_MAIN_ALGO 50
-// hysteresis for averaging only close results of ADC measurements
-#define OFFSET_FOR_AVRG 10  // ±48mV
+#if ADC_FEEDBACK_RATE/CONTROL_RATE < FILTER_DECIMATION
+    #error "Filter gives less than one value per control tick"
+#endif
+// Timer0 prescaler for the control rate (OCR0A must fit in 8 bits)
+#if F_CPU/64/CONTROL_RATE <= 256
+    #define CONTROL_TIMER_PRESCALER 64
+    #define CONTROL_TIMER_CS ((1<<CS01)|(1<<CS00))
+#elif F_CPU/256/CONTROL_RATE <= 256
+    #define CONTROL_TIMER_PRESCALER 256
+    #define CONTROL_TIMER_CS (1<<CS02)
+#elif F_CPU/1024/CONTROL_RATE <= 256
+    #define CONTROL_TIMER_PRESCALER 1024
+    #define CONTROL_TIMER_CS ((1<<CS02)|(1<<CS00))
+#else
+    #error "CONTROL_RATE is too low for Timer0"
+#endif
+// Timer0 counts since power-up (CONTROL_TIMER_PRESCALER cycles each, wraps in
+// about a second), timestamps of the input edges
+volatile uint16_t control_clock = 0;
+#define MS_TO_CLOCK(ms) ((ms)*(F_CPU/CONTROL_TIMER_PRESCALER)/1000)
+#if MS_TO_CLOCK(BUTTON_DEBOUNCE_TIME) > 65535 || MS_TO_CLOCK(SIGNALS_DEBOUNCE_TIME) < 1
+    #error "Debounce times must be 1-65535 counts of the control clock"
+#endif
+
+// From the interrupts (Timer0 may have wrapped without its ISR yet)
+static inline uint16_t control_clock_now(void) {
+    uint8_t count = TCNT0;
+    uint16_t time = control_clock + count;
+    if ( (TIFR0 & (1<<OCF0A)) && count < OCR0A/2 )
+        time += OCR0A+1;
+    return time;
+}
+
+// samples that pile up between two control ticks
+#define SAMPLES_PER_CONTROL_TICK (ADC_FEEDBACK_RATE/CONTROL_RATE+1)
+#if SAMPLES_PER_CONTROL_TICK > ADC_BUFFER_SIZE*3/4
+    #error "CONTROL_RATE is too low: ADC buffer would overflow between control ticks"
+#endif
+// Rough cost of one sample in the control ISR (CPU cycles). Processing of the whole
+// tick should take no more than a half of the tick period
+#define CYCLES_PER_SAMPLE 150
+#define CYCLES_PER_CONTROL_DECISION 1000
+#if SAMPLES_PER_CONTROL_TICK*CYCLES_PER_SAMPLE+CYCLES_PER_CONTROL_DECISION > F_CPU/CONTROL_RATE/2
+    #error "CONTROL_RATE is too high for the chosen ADC sampling rate"
+#endif
+#if NUM_OF_TIMERS > SCHEDULER_TIMERS
+    #error "Not enough software timers, increase SCHEDULER_TIMERS"
+#endif
+
+
+void handle_event(uint8_t event);
+bool pot_pickup(uint16_t pot, uint16_t value);
+void lcd_refresh(void);
+void settings_button(bool pressed);
+void menu_next(void);
+void bypass_toggle(void);
+void plasm_on(void);
+void plasm_off(void);
+void touch_tracking_on(void);
+void probe_start(void);
+void probe_moved(void);
+void touch(void);
+void regulation(void);
+#ifdef SLOPE_CORRECTION
+void calibration(void);
+#endif
+#ifdef PROFILING
+void diagnostics_refresh(void);
+#endif
 
 
 
@@ -58,6 +257,10 @@ int main(void) {
     // disable all interrupts while setup
     cli();
 
+    #ifdef PROFILING
+        profiler_init();
+    #endif
+
     /*
      *  Debug LED
      */
@@ -69,16 +272,14 @@ int main(void) {
     /*
      * LCD startup
      */
-    lcd.begin(16, 2);
-    lcd.clear();
-    lcd.print("loading...");
+    lcd_init();
+    lcd_clear();
+    lcd_print("loading...");
 
     /*
-     *  Retrieve values from EEPROM
+     *  Retrieve settings from EEPROM
      */
-    setpoint_offset = eeprom_read_word(&setpoint_offset_EEPROM);
-    cutting_height = eeprom_read_word(&cutting_height_EEPROM);
-    pierce_time = eeprom_read_byte(&pierce_time_EEPROM);
+    settings_load();
 
     /*
      *  Set directions of IOs
@@ -88,62 +289,233 @@ int main(void) {
     // inputs:
     SIGNALS_DDR &= ~( (1<<SETTINGS_BUTTON_PIN) | (1<<UP_SIGNAL_PIN) | (1<<DOWN_SIGNAL_PIN) |
                       (1<<PLASM_SIGNAL_PIN) | (1<<TOUCH_SIGNAL_PIN) );
+    #ifdef HEIGHT_LOCK_SIGNAL
+        SIGNALS_DDR &= ~(1<<HEIGHT_LOCK_SIGNAL_PIN);
+    #endif
 
     /*
-     *  Interrupts setup (so far only for up, down and settings button pins)
+     *  Inputs debouncing. Edges of all these signals are captured all the time,
+     *  their events are enabled depending on the state
      */
-    PCICR |= (1<<PCIE0);
-    PCMSK0 |= (1<<SETTINGS_BUTTON_INT) | (1<<UP_SIGNAL_INT) | (1<<DOWN_SIGNAL_INT);
+    inputs_init(SIGNALS_PIN, control_clock_now());
+    input_watch(SETTINGS_BUTTON_PIN, MS_TO_CLOCK(BUTTON_DEBOUNCE_TIME), BUTTON_EVENT);
+    input_watch(UP_SIGNAL_PIN, MS_TO_CLOCK(SIGNALS_DEBOUNCE_TIME), UP_EVENT);
+    input_watch(DOWN_SIGNAL_PIN, MS_TO_CLOCK(SIGNALS_DEBOUNCE_TIME), DOWN_EVENT);
+    input_watch(PLASM_SIGNAL_PIN, MS_TO_CLOCK(PLASM_DEBOUNCE_TIME), PLASM_EVENT);
+    input_enable( (1<<SETTINGS_BUTTON_PIN) | (1<<UP_SIGNAL_PIN) | (1<<DOWN_SIGNAL_PIN) );
 
     /*
-     *  Timer0 for the torch height control algorithm
+     *  Pin change interrupts setup (the touch one is turned on when it's needed)
      */
-    // CTC mode
-    TCCR0A |= (1<<WGM01);
-    // 1000 Hz frequency (formula from datasheet) (CONFIRMED). For getting actual frequency
-    // of controlling divide this frequency on PRESCALER_MAIN_ALGO
-    OCR0A = 124;
-    // Set prescaler to 64 and start the timer
-    TCCR0B |= (1<<CS01)|(1<<CS00);
-    // We don't have dedicated controlling procedure as we use interrupt of Timer0 for this task.
-    // So we need to activate it every time we want to start control algorithm
-    #define REGULATION_START TIMSK0|=(1<<OCIE0A)
-    #define REGULATION_STOP TIMSK0&=~(1<<OCIE0A)
+    PCICR |= (1<<PCIE0);
+    PCMSK0 |= (1<<SETTINGS_BUTTON_INT) | (1<<UP_SIGNAL_INT) | (1<<DOWN_SIGNAL_INT) |
+              (1<<PLASM_SIGNAL_INT);
+    #ifdef HEIGHT_LOCK_SIGNAL
+        // tracked all the time, the lock may already be on
+        PCMSK0 |= (1<<HEIGHT_LOCK_SIGNAL_INT);
+        regulator_hold( !(SIGNALS_PIN & (1<<HEIGHT_LOCK_SIGNAL_PIN)) );
+    #endif
 
     /*
-     *  Timer1 for LCD redrawing (2.5 Hz) (CONFIRMED)
+     *  Timer0 for the torch height control algorithm. It doesn't measure anything
+     *  itself but processes samples that ADC has gathered in the background. It also
+     *  ticks all the software timers so it runs all the time
      */
-    OCR1A = 12499;
-    // Mode CTC on OCR1A, set prescaler to 256 and start the timer
-    TCCR1B |= (1<<WGM12) | (1<<CS12);
-    // We don't have dedicated routine for LCD processing as we use interrupt of Timer1 for this task.
-    // So we need to enable interrupt every time when we want to constantly refreshing LCD. See
-    // corresponding ISR for more details
-    #define LCD_ROUTINE_ON TIMSK1|=(1<<OCIE1A)
-    #define LCD_ROUTINE_OFF TIMSK1&=~(1<<OCIE1A)
+    // CTC mode
+    TCCR0A |= (1<<WGM01);
+    // CONTROL_RATE frequency (formula from datasheet)
+    OCR0A = F_CPU/CONTROL_TIMER_PRESCALER/CONTROL_RATE - 1;
+    // Set prescaler and start the timer
+    TCCR0B |= CONTROL_TIMER_CS;
+    TIMSK0 |= (1<<OCIE0A);
 
-    motor_init();
+    ZMotor::init();
 
     adc_init();
 
+    #ifdef TELEMETRY
+        telemetry_init();
+    #endif
+
     /*
      *  Handle bypass mode
      */
-    if (eeprom_read_byte(&bypass_ON_flag_EEPROM)) {
-        lcd.clear();
-        lcd.print("regulation off");
+    if (settings.bypass) {
+        lcd_clear();
+        lcd_print("regulation off");
     }
     else {
         // LCD timer ON
         LCD_ROUTINE_ON;
-        // Plasm interrupt ON
-        PCMSK0 |= (1<<PLASM_SIGNAL_INT);
+        // Plasm events ON
+        input_enable(1<<PLASM_SIGNAL_PIN);
     }
 
     // finally globally enable interrupts
     sei();
 
-    while (1) {}
+    /*
+     *  Main loop. Interrupts only post events, all the rest is done here. Changes
+     *  of the screen are pushed to the LCD between events. CPU sleeps until the
+     *  next interrupt when there is nothing to do
+     */
+    while (1) {
+        uint8_t event = event_get();
+        if (event != NO_EVENT)
+            handle_event(event);
+        else if (!lcd_update())
+            scheduler_sleep();
+    }
+}
+
+
+
+/*
+ *  State machine of the whole device (see UML diagram)
+ */
+void handle_event(uint8_t event) {
+
+    char *p;
+
+    switch (event) {
+
+        case BUTTON_EVENT:
+            settings_button( !input_level(SETTINGS_BUTTON_PIN) );
+            break;
+
+        case BYPASS_HOLD_EVENT:
+            bypass_toggle();
+            break;
+
+        case UP_EVENT:
+            if ( input_level(UP_SIGNAL_PIN) )
+                ZMotor::stop();
+            else
+                ZMotor::up();
+            break;
+
+        case DOWN_EVENT:
+            if ( input_level(DOWN_SIGNAL_PIN) )
+                ZMotor::stop();
+            else
+                ZMotor::down();
+            break;
+
+        case PLASM_EVENT:
+            // LOW to HIGH pin change (plasm is OFF)
+            if ( input_level(PLASM_SIGNAL_PIN) ) {
+                if (state != IDLE_STATE)
+                    plasm_off();
+            }
+            // HIGH to LOW pin change (plasm is ON)
+            else if (state == IDLE_STATE) {
+                plasm_on();
+            }
+            break;
+
+        case PROBE_MOVED_EVENT:
+            if (state == START_STATE)
+                probe_moved();
+            break;
+
+        case TOUCH_EVENT:
+            if (state == START_STATE)
+                touch();
+            break;
+
+        // the torch is already going up, only show it
+        case DIVE_EVENT:
+            if (menu == WORK_MENU)
+                lcd_refresh();
+            break;
+
+        // Torch is at the cutting height. Wait a bit more for pierce (torch is fully
+        // burning and all metal droplets can't affect the measurements)
+        case LIFTED_EVENT:
+            timer_start(PIERCE_TIMER, MS_TO_TICKS(current_profile->pierce_time*PIERCE_TIME_ELEMENTARY_DELAY),
+                        PIERCE_DONE_EVENT);
+            break;
+
+        case PIERCE_DONE_EVENT:
+            if (state == PIERCE_STATE) {
+                // lasts up to SETPOINT_MAX_TIME
+                lcd_clear();
+                lcd_print("define sp...");
+
+                // throw away samples measured during the lift and pierce, the control
+                // algorithm timer defines the setpoint from the fresh ones
+                adc_feedback_flush();
+                regulator_settings.setpoint_offset = current_profile->setpoint_offset;
+                #ifdef PID_REGULATION
+                    regulator_settings.kp = current_profile->kp;
+                    regulator_settings.ki = current_profile->ki;
+                    regulator_settings.kd = current_profile->kd;
+                #endif
+                #ifdef SLOPE_CORRECTION
+                    regulator_settings.slope = job_slope_known ? job_slope : 0;
+                    correcting = false;
+                #endif
+                regulator_start(&regulator_settings);
+                motor_command = 0;
+                state = DEFINE_SP_STATE;
+            }
+            break;
+
+        case SETPOINT_DEFINED_EVENT:
+            if (state == DEFINE_SP_STATE) {
+                dives = 0;
+                #ifdef SLOPE_CORRECTION
+                    if (!job_slope_known) {
+                        calibration_cnt = 0;
+                        calibration_sum = 0;
+                        calibration_returning = false;
+                        state = CALIBRATE_STATE;
+                        ZMotor::move(CALIBRATION_STEPS);
+                    }
+                    else
+                #endif
+                {
+                    state = WORK_STATE;
+                    touch_tracking_on();
+                }
+
+                // setpoint and how sure we are in it
+                p = format_fixed( format_string(bufferA, "sp"), adc_to_arc_voltage(setpoint>>FILTER_EXTRA_BITS), 0, 2 );
+                format_string( format_fixed( format_string(p, "V"), setpoint_confidence, 5, 0 ), "%" );
+                lcd_clear();
+                lcd_print(bufferA);
+
+                menu = WORK_MENU;
+
+                // Turn ON timer for LCD when setpoint is defined and main
+                // regulation mode is started
+                LCD_ROUTINE_ON;
+            }
+            break;
+
+        case LCD_REFRESH_EVENT:
+            lcd_refresh();
+            break;
+    }
+}
+
+
+
+/*
+ *  Motor driver interrupts, the driver enables the ones it uses
+ */
+ISR (TIMER2_COMPA_vect) {
+    ZMotor::timer2_compa();
+}
+
+
+ISR (TIMER2_COMPB_vect) {
+    ZMotor::timer2_compb();
+}
+
+
+ISR (TIMER1_COMPA_vect) {
+    ZMotor::timer1_compa();
 }
 
 
@@ -153,81 +525,193 @@ int main(void) {
  */
 ISR (TIMER0_COMPA_vect) {
 
-    // measure voltage of the arc
-    feedback = adc_read(ADC_FEEDBACK_PIN);
+    // Timer0 has been counting since the compare match
+    PROFILE_CONTROL_LATENCY((uint16_t)TCNT0*CONTROL_TIMER_PRESCALER);
+    PROFILE_ISR_BEGIN(PROFILE_CONTROL_ISR);
+
+    control_clock += OCR0A+1;
+    scheduler_tick();
+    inputs_tick(control_clock_now());
 
-    // Define setpoint by measured values that staying in ±OFFSET_FOR_AVRG interval
-    // (NUM_OF_VALUES_FOR_SETPOINT_DEFINITION values)
-    if (setpoint_defined == false) {
-        if (feedback_accum_cnt < NUM_OF_VALUES_FOR_SETPOINT_DEFINITION) {
-            if (abs(feedback-feedback_prev) <= OFFSET_FOR_AVRG) {
-                feedback_accum += feedback;
-                feedback_accum_cnt++;
+    switch (state) {
+        case START_STATE:
+            if ( probe_moving && !ZMotor::busy() ) {
+                probe_moving = false;
+                event_post(PROBE_MOVED_EVENT);
             }
-        }
-        else {
-            setpoint_defined = true;
-            // calculate setpoint
-            setpoint = feedback_accum/NUM_OF_VALUES_FOR_SETPOINT_DEFINITION;
+            break;
+
+        case PIERCE_STATE:
+            if ( lifting && !ZMotor::busy() ) {
+                lifting = false;
+                event_post(LIFTED_EVENT);
+            }
+            break;
+
+    #ifdef SLOPE_CORRECTION
+        case CALIBRATE_STATE:
+            regulation();
+            calibration();
+            #ifdef TELEMETRY
+                telemetry_frame(state, feedback_avrg, setpoint, ZMotor::position(), motor_command);
+            #endif
+            break;
+    #endif
+
+        // back to the regulation as soon as the retract is done
+        case DIVE_STATE:
+            if ( !ZMotor::busy() ) {
+                state = WORK_STATE;
+                touch_tracking_on();
+            }
+            // fall through
+        case DEFINE_SP_STATE:
+        case WORK_STATE:
+            regulation();
+            #ifdef TELEMETRY
+                telemetry_frame(state, feedback_avrg, setpoint, ZMotor::position(), motor_command);
+            #endif
+            break;
+    }
 
-            feedback_accum = 0;
-            feedback_accum_cnt = 0;
+    PROFILE_ISR_END(PROFILE_CONTROL_ISR);
+    PROFILE_CONTROL_DONE();
+}
 
-            sprintf(bufferA, "measured: %0.2fV", ADC_REFERENCE_VOLTAGE*setpoint/1023);
-            lcd.clear();
-            lcd.print(bufferA);
 
-            menu = WORK_MENU;
 
-            // Turn ON timer interrupt for LCD when setpoint is defined and main
-            // regulation mode is started
-            LCD_ROUTINE_ON;
-        }
+/*
+ *  Control algorithm, runs on every control timer tick
+ */
+void regulation(void) {
+
+    // process all arc voltage samples measured by ADC since the previous tick
+    while (adc_feedback_available()) {
+        uint16_t sample = adc_feedback_get();
+        #ifdef TELEMETRY
+            telemetry_sample(sample);
+        #endif
+        regulator_sample(sample);
     }
-    // setpoint defined
-    else {
-        // Same as above, we accumulate ADC values that close to each other
-        // (±OFFSET_FOR_AVRG hysteresis interval)
-        if (abs(feedback-feedback_prev) <= OFFSET_FOR_AVRG) {
-            feedback_accum += feedback;
-            feedback_accum_cnt++;
-        }
 
-        // We gather data at each ISR flash but process it only each
-        // PRESCALER_MAIN_ALGO times
-        if (++prescaler_cnt == PRESCALER_MAIN_ALGO) {
-            prescaler_cnt = 0;
-
-            feedback_avrg = feedback_accum/feedback_accum_cnt;
-            feedback_accum = 0;
-            feedback_accum_cnt = 0;
-
-            // lift up if torch is too low (taking into account the hysteresis interval)
-            if (feedback_avrg < (setpoint-setpoint_offset))
-                motor_up();
-            // get down if torch is too high (taking into account the hysteresis interval)
-            else if (feedback_avrg > (setpoint+setpoint_offset))
-                motor_down();
-            // otherwise stop
-            else
-                motor_stop();
+    uint8_t result = regulator_tick(&motor_command);
+    if (result == REGULATOR_DEFINING_SETPOINT)
+        return;
+    if (result == REGULATOR_SETPOINT_DEFINED)
+        event_post(SETPOINT_DEFINED_EVENT);
+    // filter keeps up but the motor is busy with the retract (or the calibration)
+    if (state == DIVE_STATE || state == CALIBRATE_STATE)
+        return;
+
+#ifdef SLOPE_CORRECTION
+    // a correction move isn't interrupted and the arc has to settle after it
+    if (correcting) {
+        if (ZMotor::busy())
+            return;
+        if (correction_settle_cnt) {
+            correction_settle_cnt--;
+            return;
         }
+        correcting = false;
+        regulator_move_done();
     }
+    if (result == REGULATOR_MOVE) {
+        ZMotor::move(motor_command);
+        correcting = true;
+        correction_settle_cnt = MS_TO_TICKS(CORRECTION_SETTLE_TIME);
+        return;
+    }
+#endif
+
+#ifdef PID_REGULATION
+    ZMotor::speed(motor_command);
+#else
+    if (motor_command > 0)
+        ZMotor::up();
+    else if (motor_command < 0)
+        ZMotor::down();
+    else
+        ZMotor::stop();
+#endif
+}
+
+
 
-    // store previous value
-    feedback_prev = feedback;
+#ifdef ANTI_DIVE
+/*
+ *  Every arc voltage sample right from the ADC interrupt: the torch is frozen as
+ *  soon as a jump is seen, the control ticks keep it till the lock is over
+ */
+void adc_feedback_hook(uint16_t sample) {
+    if ( regulator_watch(sample) && state == WORK_STATE )
+        ZMotor::stop();
 }
+#endif
 
 
 
+#ifdef SLOPE_CORRECTION
 /*
- *  Interrupt handler for LCD menu timer
+ *  Slope measurement, runs on every control timer tick in the Calibrate state
  */
-ISR (TIMER1_COMPA_vect) {
+void calibration(void) {
+
+    // the move up or back is still on
+    if ( ZMotor::busy() )
+        return;
+
+    if (calibration_returning) {
+        state = WORK_STATE;
+        touch_tracking_on();
+        return;
+    }
+
+    if (++calibration_cnt <= MS_TO_TICKS(CALIBRATION_SETTLE_TIME))
+        return;
+    calibration_sum += feedback_avrg;
+    if (calibration_cnt < MS_TO_TICKS(CALIBRATION_SETTLE_TIME+CALIBRATION_TIME))
+        return;
+
+    int32_t rise = calibration_sum/MS_TO_TICKS(CALIBRATION_TIME) - setpoint;
+    int32_t slope = (rise<<8)/CALIBRATION_STEPS;
+    // constant speed for this job otherwise
+    job_slope = slope >= CALIBRATION_MIN_SLOPE ? slope : 0;
+    job_slope_known = true;
+    regulator_set_slope(job_slope);
+
+    calibration_returning = true;
+    ZMotor::move(-CALIBRATION_STEPS);
+}
+#endif
+
+
+
+/*
+ *  True once the pot (mapped to the units of the value) has reached the value
+ *  of the menu or has crossed it
+ */
+bool pot_pickup(uint16_t pot, uint16_t value) {
+    if (!pot_picked_up) {
+        int8_t side = pot < value ? -1 : pot > value ? 1 : 0;
+        if (!pot_side)
+            pot_side = side;
+        pot_picked_up = side != pot_side || !side;
+    }
+    return pot_picked_up;
+}
+
+
+/*
+ *  LCD menu routine (periodic)
+ */
+void lcd_refresh(void) {
+
+    char *p;
+    uint16_t pot;
 
     // if bypass mode ON
-    if ( eeprom_read_byte(&bypass_ON_flag_EEPROM) ) {
-        // turn off LCD timer interrupt (i.e. this interrupt)
+    if (settings.bypass) {
+        // turn off LCD timer (i.e. this routine)
         LCD_ROUTINE_OFF;
         return;
     }
@@ -236,223 +720,438 @@ ISR (TIMER1_COMPA_vect) {
 
         // print only second row - current voltage (averaged)
         case WORK_MENU:
-            sprintf(bufferB, "%0.2f", ADC_REFERENCE_VOLTAGE*feedback_avrg/1023);
+            p = format_fixed(bufferB, adc_to_arc_voltage(feedback_avrg>>FILTER_EXTRA_BITS), 0, 2);
+            if (dives)
+                format_fixed( format_string(p, " dive"), dives, 0, 0 );
             break;
 
-        // print only once, then turn off LCD timer interrupt
+        // print only once, then turn off LCD timer
         case IDLE_MENU:
-            sprintf(bufferA, "sp: %0.2fV+-%3umV", ADC_REFERENCE_VOLTAGE*setpoint/1023,
-                                                  (uint16_t)(1000*ADC_REFERENCE_VOLTAGE*setpoint_offset/1023));
-            sprintf(bufferB, "lft%u dlay%u", cutting_height,
-                                             pierce_time*PIERCE_TIME_ELEMENTARY_DELAY);
-            lcd.clear();
-            lcd.print(bufferA);
-            // turn off LCD timer interrupt
+            p = format_fixed( format_string(bufferA, "sp"), adc_to_arc_voltage(setpoint>>FILTER_EXTRA_BITS), 0, 2 );
+            format_string( format_fixed( format_string(p, "V+-"), adc_to_mv(current_profile->setpoint_offset), 3, 0 ), "mV" );
+            // profile number, lift and pierce time
+            p = format_string( format_fixed(bufferB, settings.profile+1, 0, 0), ":" );
+            p = format_string( format_fixed(p, current_profile->cutting_height, 0, 0), "st " );
+            format_string( format_fixed(p, current_profile->pierce_time*PIERCE_TIME_ELEMENTARY_DELAY, 0, 0), "ms" );
+            lcd_clear();
+            lcd_print(bufferA);
+            // turn off LCD timer
             LCD_ROUTINE_OFF;
             break;
 
-        // For the next 3 menu entries first string (bufferA) was printed outside this ISR
-        // (at settings button ISR) so we only need to handle second row
+        // For the next menu entries first string (bufferA) was printed outside this routine
+        // (on settings button press) so we only need to handle second row
+        case PROFILE_MENU:
+            // switched at once, the next menus set the values of this profile
+            pot = (uint32_t)adc_settings_value()*PROFILES/1024;
+            if ( pot_pickup(pot, settings.profile) )
+                settings_select(pot);
+            p = format_string( format_string(format_fixed(bufferB, settings.profile+1, 0, 0), " "),
+                               profile_names[settings.profile] );
+            // names differ in length, clear the rest of the previous one
+            while (p < bufferB+LCD_COLS)
+                *p++ = ' ';
+            *p = '\0';
+            break;
+
         case cutting_height_MENU:
             // We don't map this, the default interval 0-1023 is OK for us
             // since ~200 steps is a one full revolution
-            cutting_height = adc_read(ADC_SETTINGS_PIN);
-            sprintf(bufferB, "%4u steps", cutting_height);
+            pot = adc_settings_value();
+            if ( pot_pickup(pot, current_profile->cutting_height) )
+                current_profile->cutting_height = pot;
+            p = format_string( format_fixed(bufferB, current_profile->cutting_height, 4, 0), "st " );
+            format_string( format_fixed(p, steps_to_um(current_profile->cutting_height)/10, 0, 2), "mm" );
             break;
 
         case SETPOINT_OFFSET_MENU:
-            setpoint_offset = map( adc_read(ADC_SETTINGS_PIN), 0, 1023,
-                                   1023*SETPOINT_OFFSET_MIN_SET_VOLTAGE/ADC_REFERENCE_VOLTAGE,
-                                   1023*SETPOINT_OFFSET_MAX_SET_VOLTAGE/ADC_REFERENCE_VOLTAGE  );
-            sprintf(bufferB, "%3umV", (uint16_t)(1000*ADC_REFERENCE_VOLTAGE*setpoint_offset/1023));
+            pot = mv_to_adc(SETPOINT_OFFSET_MIN_SET_MILLIVOLTS) +
+                (uint32_t)adc_settings_value()*( mv_to_adc(SETPOINT_OFFSET_MAX_SET_MILLIVOLTS) -
+                                                 mv_to_adc(SETPOINT_OFFSET_MIN_SET_MILLIVOLTS) )/1023;
+            if ( pot_pickup(pot, current_profile->setpoint_offset) )
+                current_profile->setpoint_offset = pot;
+            format_string( format_fixed(bufferB, adc_to_mv(current_profile->setpoint_offset), 3, 0), "mV" );
             break;
 
         case PIERCE_TIME_MENU:
-            pierce_time = map(adc_read(ADC_SETTINGS_PIN), 0, 1023, 0, PIERCE_TIME_MAX_TIME);
-            sprintf(bufferB, "%5ums", pierce_time*PIERCE_TIME_ELEMENTARY_DELAY);
+            pot = adc_settings_value()*PIERCE_TIME_MAX_TIME/1023;
+            if ( pot_pickup(pot, current_profile->pierce_time) )
+                current_profile->pierce_time = pot;
+            format_string( format_fixed(bufferB, current_profile->pierce_time*PIERCE_TIME_ELEMENTARY_DELAY, 5, 0), "ms" );
+            break;
+
+    #ifdef PID_REGULATION
+        case PID_KP_MENU:
+            pot = adc_settings_value();
+            if ( pot_pickup(pot, current_profile->kp) )
+                current_profile->kp = pot;
+            format_fixed(bufferB, current_profile->kp, 4, 0);
+            break;
+
+        case PID_KI_MENU:
+            pot = adc_settings_value();
+            if ( pot_pickup(pot, current_profile->ki) )
+                current_profile->ki = pot;
+            format_fixed(bufferB, current_profile->ki, 4, 0);
+            break;
+
+        case PID_KD_MENU:
+            pot = adc_settings_value();
+            if ( pot_pickup(pot, current_profile->kd) )
+                current_profile->kd = pot;
+            format_fixed(bufferB, current_profile->kd, 4, 0);
+            break;
+    #endif
+
+    #ifdef PROFILING
+        case DIAGNOSTICS_MENU:
+            diagnostics_refresh();
             break;
+    #endif
     }
 
     // we always print second row of LCD here
-    lcd.setCursor(0, 1);
-    lcd.print(bufferB);
+    lcd_set_cursor(0, 1);
+    lcd_print(bufferB);
 }
 
 
 
 /*
- *  Input signals interrupt
+ *  Settings button (debounced)
  */
-ISR (PCINT0_vect) {
-
-    // determine which bits have changed
-    uint8_t changed_bits = SIGNALS_PIN ^ signals_port_history;
-    // store current state as old one
-    signals_port_history = SIGNALS_PIN;
-
+void settings_button(bool pressed) {
+
+    // HIGH to LOW pin change
+    if (pressed) {
+        // hold the button to turn ON/OFF bypass mode (valid only from idle mode),
+        // short click switches the menu on release
+        if (menu == IDLE_MENU) {
+            timer_start(BYPASS_TIMER, MS_TO_TICKS(BYPASS_HOLD_TIME), BYPASS_HOLD_EVENT);
+            return;
+        }
+    }
+    // LOW to HIGH pin change. Other menus are switched on press already
+    else {
+        if ( !timer_active(BYPASS_TIMER) ) return;
+        timer_stop(BYPASS_TIMER);
+    }
 
-    if ( changed_bits & (1<<SETTINGS_BUTTON_PIN) ) {
-        // Anti-jitter delay. Button is pressed by a human so generally we need some
-        // significant delay (also, the button quality is another one factor)
-        _delay_ms(100);
+    // ignore short clicks in bypass mode
+    if (settings.bypass) return;
 
-        // HIGH to LOW pin change
-        if ( !(SIGNALS_PIN & (1<<SETTINGS_BUTTON_PIN)) ) {
+    menu_next();
+}
 
-            // hold the button for about 7.5s to turn ON/OFF bypass mode (valid only from idle mode)
-            uint8_t toggle_bypass_cnt = 0;
-            while ( !(SIGNALS_PIN & (1<<SETTINGS_BUTTON_PIN)) && (menu==IDLE_MENU) ) {
-                _delay_ms(100);
-                if (++toggle_bypass_cnt > 75) {  // 75*100ms = 7.5s
-                    toggle_bypass_cnt = 0;
 
-                    // write status in EEPROM
-                    eeprom_update_byte(&bypass_ON_flag_EEPROM, eeprom_read_byte(&bypass_ON_flag_EEPROM)^1);
+/*
+ *  Menu routine. We cycle through the menu entries (at each button press), the
+ *  entered values are kept in RAM and stored all at once on return to Idle mode
+ */
+void menu_next(void) {
 
-                    // toggle plasm interrupt
-                    PCMSK0 ^= (1<<PLASM_SIGNAL_INT);
+    char *p = bufferA;
 
-                    lcd.clear();
-                    lcd.print("regulation off");
+    #ifdef PROFILING
+        // numbers seen the last are kept for the readout by the programmer
+        if (menu == DIAGNOSTICS_MENU)
+            profiler_dump(&profile);
+    #endif
 
-                    // LCD timer interrupt ON
-                    LCD_ROUTINE_ON;
+    if (++menu == NUM_OF_MENUS) {
+        menu = IDLE_MENU;
+        // nothing is written if nothing has changed
+        settings_save();
+    }
+    // the pot has to be picked up in every menu anew
+    pot_picked_up = false;
+    pot_side = 0;
 
-                    return;
-                }
-            }
-            // ignore short clicks in bypass mode
-            if ( eeprom_read_byte(&bypass_ON_flag_EEPROM) ) return;
-
-
-            /*
-             *  Menu routine. We cycle through the menu entries and store
-             *  the entered value from the previous menu (at each button press)
-             */
-            if (++menu == NUM_OF_MENUS)
-                menu = IDLE_MENU;
-
-            if (menu == IDLE_MENU) {
-                // save previous parameter in EEPROM on button press
-                eeprom_update_byte(&pierce_time_EEPROM, pierce_time);
-                // turn on plasm interrupt only in Idle mode
-                PCMSK0 |= (1<<PLASM_SIGNAL_INT);
-            }
-            else {
-                // turn off plasm interrupt in settings mode
-                PCMSK0 &= ~(1<<PLASM_SIGNAL_INT);
+    #ifdef SLOPE_CORRECTION
+        // new job: measure the slope anew
+        job_slope_known = false;
+    #endif
 
-                if (menu == cutting_height_MENU) {
-                    sprintf(bufferA, "lift (%u):", cutting_height);
-                }
-                else if (menu == SETPOINT_OFFSET_MENU) {
-                    eeprom_update_word(&cutting_height_EEPROM, cutting_height);
-                    sprintf(bufferA, "offset (%u):", (uint16_t)(1000*ADC_REFERENCE_VOLTAGE*setpoint_offset/1023));
-                }
-                else if (menu == PIERCE_TIME_MENU) {
-                    eeprom_update_word(&setpoint_offset_EEPROM, setpoint_offset);
-                    sprintf(bufferA, "delay (%u):", pierce_time*PIERCE_TIME_ELEMENTARY_DELAY);
-                }
+    if (menu == IDLE_MENU) {
+        // turn on plasm events only in Idle mode
+        input_enable(1<<PLASM_SIGNAL_PIN);
+    }
+    else {
+        // turn off plasm events in settings mode
+        input_disable(1<<PLASM_SIGNAL_PIN);
 
-                lcd.clear();
-                lcd.print(bufferA);
-                // timer interrupt for LCD ON
-                LCD_ROUTINE_ON;
-            }
+        if (menu == PROFILE_MENU) {
+            p = format_fixed( format_string(bufferA, "profile ("), settings.profile+1, 0, 0 );
+        }
+        else if (menu == cutting_height_MENU) {
+            p = format_fixed( format_string(bufferA, "lift ("), current_profile->cutting_height, 0, 0 );
+        }
+        else if (menu == SETPOINT_OFFSET_MENU) {
+            p = format_fixed( format_string(bufferA, "offset ("), adc_to_mv(current_profile->setpoint_offset), 0, 0 );
+        }
+        else if (menu == PIERCE_TIME_MENU) {
+            p = format_fixed( format_string(bufferA, "delay ("),
+                              current_profile->pierce_time*PIERCE_TIME_ELEMENTARY_DELAY, 0, 0 );
+        }
+    #ifdef PID_REGULATION
+        else if (menu == PID_KP_MENU) {
+            p = format_fixed( format_string(bufferA, "Kp ("), current_profile->kp, 0, 0 );
+        }
+        else if (menu == PID_KI_MENU) {
+            p = format_fixed( format_string(bufferA, "Ki ("), current_profile->ki, 0, 0 );
         }
+        else if (menu == PID_KD_MENU) {
+            p = format_fixed( format_string(bufferA, "Kd ("), current_profile->kd, 0, 0 );
+        }
+    #endif
+    #ifdef PROFILING
+        else if (menu == DIAGNOSTICS_MENU) {
+            // pages are printed by the LCD routine from now on
+            diagnostics_refresh_cnt = 0;
+            profiler_snapshot(&profile);
+            p = format_fixed( format_string(bufferA, "missed ("), profile.missed_ticks, 0, 0 );
+        }
+    #endif
+        format_string(p, "):");
+
+        lcd_clear();
+        lcd_print(bufferA);
+        // timer for LCD ON
+        LCD_ROUTINE_ON;
     }
+}
 
 
-    // Note that it's important to use if-elseif construction because otherwise
-    // we can fall to the strange and unpredicted behavior
-    else if ( changed_bits & (1<<UP_SIGNAL_PIN) ) {
-        if ( SIGNALS_PIN & (1<<UP_SIGNAL_PIN) )
-            motor_stop();
-        else
-            motor_up();
-    }
+void bypass_toggle(void) {
+    // write status in EEPROM
+    settings.bypass ^= 1;
+    settings_save();
 
+    // toggle plasm events
+    if (settings.bypass)
+        input_disable(1<<PLASM_SIGNAL_PIN);
+    else
+        input_enable(1<<PLASM_SIGNAL_PIN);
+
+    lcd_clear();
+    lcd_print("regulation off");
+
+    // LCD timer ON
+    LCD_ROUTINE_ON;
+}
+
+
+#ifdef PROFILING
+/*
+ *  Diagnostics menu (profiling builds only): min/avg/max durations of each
+ *  profiled ISR in microseconds, then missed control ticks, the worst control
+ *  tick latency and stack usage. Pages change every DIAGNOSTICS_PAGE_TIME
+ */
+void diagnostics_refresh(void) {
+    static const char *const isr_names[PROFILE_ISRS] = {"ctl", "motor", "adc", "sig", "uart"};
+    char *p;
+
+    profiler_snapshot(&profile);
+    uint8_t page = diagnostics_refresh_cnt++ / (DIAGNOSTICS_PAGE_TIME/LCD_REFRESH_PERIOD);
+    if (page == DIAGNOSTICS_PAGES) {
+        diagnostics_refresh_cnt = 1;
+        page = 0;
+    }
 
-    else if ( changed_bits & (1<<DOWN_SIGNAL_PIN) ) {
-        if ( SIGNALS_PIN & (1<<DOWN_SIGNAL_PIN) )
-            motor_stop();
-        else
-            motor_down();
+    if (page < PROFILE_ISRS) {
+        const ProfileStats *isr = &profile.isr[page];
+        format_fixed( format_string( format_string(bufferA, isr_names[page]), " #" ), isr->count, 0, 0 );
+        // 0.1us units
+        p = format_fixed(bufferB, (uint32_t)isr->min*10/(F_CPU/1000000), 5, 1);
+        p = format_fixed(p, isr->count ? isr->sum/isr->count*10/(F_CPU/1000000) : 0, 5, 1);
+        format_fixed(p, (uint32_t)isr->max*10/(F_CPU/1000000), 5, 1);
+    }
+    else {
+        p = format_fixed( format_string(bufferA, "miss"), profile.missed_ticks, 0, 0 );
+        format_string( format_fixed( format_string(p, " lat"),
+                                     profile.control_latency_max/(F_CPU/1000000), 0, 0 ), "us" );
+        p = format_fixed( format_string(bufferB, "stk"), profile.stack_used, 0, 0 );
+        format_fixed( format_string(p, " free"), profile.stack_free, 0, 0 );
     }
 
+    lcd_clear();
+    lcd_print(bufferA);
+}
+#endif
 
-    else if ( changed_bits & (1<<PLASM_SIGNAL_PIN) ) {
-        // plasm relay cause jitter
-        _delay_ms(20);
 
-        // LOW to HIGH pin change (plasm is OFF)
-        if ( SIGNALS_PIN & (1<<PLASM_SIGNAL_PIN) ) {
-            // regulation OFF (imer interrupt for algorithm OFF)
-            REGULATION_STOP;
-            motor_stop();
+void plasm_on(void) {
+    state = START_STATE;
 
-            // reset variables
-            prescaler_cnt = 0;
-            feedback_accum = 0;
-            feedback_accum_cnt = 0;
-            feedback_avrg = 0;
-            setpoint_defined = false;
+    // turn on touch tracking (do it only here to prevent any random triggering)
+    touch_tracking_on();
+    // events OFF for all signals except plasm (and touch)
+    input_disable( (1<<SETTINGS_BUTTON_PIN) | (1<<UP_SIGNAL_PIN) | (1<<DOWN_SIGNAL_PIN) );
+    timer_stop(BYPASS_TIMER);
+    // move down till the torch touch the metal
+    probe_start();
 
-            // interrupt for signals ON
-            PCMSK0 |= (1<<SETTINGS_BUTTON_INT) | (1<<UP_SIGNAL_INT) | (1<<DOWN_SIGNAL_INT);
-            // turn off touch tracking
-            PCMSK0 &= ~(1<<TOUCH_SIGNAL_INT);
+    lcd_clear();
+    lcd_print("start...");
+}
 
-            // go to Idle mode
-            menu = IDLE_MENU;
 
-            // in case of interrupted regulation session Timer interrupt for LCD ON
-            LCD_ROUTINE_ON;
-        }
+void plasm_off(void) {
+    // regulation OFF (control algorithm timer does nothing in Idle state)
+    state = IDLE_STATE;
+    ZMotor::stop();
 
-        // HIGH to LOW pin change (plasm is ON)
-        else {
-            // turn off touch tracking (do it only here to prevent any random triggering)
-            PCMSK0 |= (1<<TOUCH_SIGNAL_INT);
-            // interrupt OFF for all signals except PLASM_SIGNAL_PIN and TOUCH_SIGNAL_PIN
-            PCMSK0 &= ~( (1<<SETTINGS_BUTTON_INT) | (1<<UP_SIGNAL_INT) | (1<<DOWN_SIGNAL_INT) );
-            // move down till the torch touch the metal
-            motor_down();
-
-            lcd.clear();
-            lcd.print("start...");
-        }
+    // reset variables
+    lifting = false;
+    probe_moving = false;
+    #ifdef SLOPE_CORRECTION
+        correcting = false;
+    #endif
+    timer_stop(PIERCE_TIMER);
+    regulator_stop();
+
+    // events of signals ON
+    input_enable( (1<<SETTINGS_BUTTON_PIN) | (1<<UP_SIGNAL_PIN) | (1<<DOWN_SIGNAL_PIN) );
+    // turn off touch tracking
+    PCMSK0 &= ~(1<<TOUCH_SIGNAL_INT);
+
+    // go to Idle mode
+    menu = IDLE_MENU;
+
+    // in case of interrupted regulation session timer for LCD ON
+    LCD_ROUTINE_ON;
+}
+
+
+// Edges are found against the pins history so it must know the touch pin as it
+// is now (it may have changed while the tracking was off)
+void touch_tracking_on(void) {
+    uint8_t sreg = SREG;
+    cli();
+    signals_port_history = (signals_port_history & ~(1<<TOUCH_SIGNAL_PIN)) |
+                           (SIGNALS_PIN & (1<<TOUCH_SIGNAL_PIN));
+    PCMSK0 |= (1<<TOUCH_SIGNAL_INT);
+    SREG = sreg;
+}
+
+
+void probe_start(void) {
+    if ( touch_position_known && ZMotor::position() > touch_position+PROBE_CLEARANCE ) {
+        probe_phase = APPROACH_PHASE;
+        probe_moving = true;
+        ZMotor::move_to(touch_position+PROBE_CLEARANCE);
+    }
+    // nothing to approach to (or no room for that)
+    else {
+        probe_phase = PROBE_PHASE;
+        ZMotor::down();
     }
+}
+
 
+// Fast approach or back-off is over
+void probe_moved(void) {
+    switch (probe_phase) {
+        case APPROACH_PHASE:
+            // unless the touch has already stopped it
+            if (PCMSK0 & (1<<TOUCH_SIGNAL_INT)) {
+                probe_phase = PROBE_PHASE;
+                ZMotor::down();
+            }
+            break;
 
-    else if ( changed_bits & (1<<TOUCH_SIGNAL_PIN) ) {
+        case BACKOFF_PHASE:
+            // still touching, back off more
+            if ( !(SIGNALS_PIN & (1<<TOUCH_SIGNAL_PIN)) ) {
+                probe_moving = true;
+                ZMotor::move(PROBE_BACKOFF_STEPS);
+                break;
+            }
+            probe_phase = RETOUCH_PHASE;
+            touch_tracking_on();
+            ZMotor::speed(-PROBE_RETOUCH_SPEED);
+            break;
+    }
+}
 
-        // HIGH to LOW pin change
-        if ( !(SIGNALS_PIN & (1<<TOUCH_SIGNAL_PIN)) ) {
 
-            motor_stop();
-            // turn off touch tracking
-            PCMSK0 &= ~(1<<TOUCH_SIGNAL_INT);
-            // lift to desired distance of cutting the metal
-            motor_move(cutting_height);
+// motor is already stopped by the interrupt
+void touch(void) {
+    #ifdef PROBE_RETOUCH
+        bool retouch = probe_phase != RETOUCH_PHASE;
+    #else
+        // stopped from the full speed (plate is higher than expected)
+        bool retouch = probe_phase == APPROACH_PHASE;
+    #endif
+    if (retouch) {
+        probe_phase = BACKOFF_PHASE;
+        probe_moving = true;
+        ZMotor::move(PROBE_BACKOFF_STEPS);
+        return;
+    }
 
-            // Wait a bit for pierce (torch is fully burning and all metal droplets
-            // can't affect the measurements)
-            lcd.clear();
-            lcd.print("pierce...");
-            uint8_t pierce_time_cnt = pierce_time;
-            do {
-                _delay_ms(PIERCE_TIME_ELEMENTARY_DELAY);
-            } while (--pierce_time_cnt);
+    touch_position = ZMotor::position();
+    touch_position_known = true;
+    state = PIERCE_STATE;
 
-            // If you see this, it means very noisy signal and/or too many points for setpoint definition
-            // (NUM_OF_VALUES_FOR_SETPOINT_DEFINITION), and/or very small interval for averaging (OFFSET_FOR_AVRG)
-            lcd.clear();
-            lcd.print("define sp...");
+    // lift to desired distance of cutting the metal (in background), control
+    // algorithm timer tells when it's done
+    lifting = true;
+    ZMotor::move(current_profile->cutting_height);
 
-            // timer interrupt for algorithm ON
-            REGULATION_START;
+    lcd_clear();
+    lcd_print("pierce...");
+}
+
+
+
+/*
+ *  Input signals interrupt. Only the touch is handled right here (motor must be
+ *  stopped immediately), all other signals are passed to the main loop
+ */
+ISR (PCINT0_vect) {
+
+    PROFILE_ISR_BEGIN(PROFILE_SIGNALS_ISR);
+
+    uint8_t signals = SIGNALS_PIN;
+    // determine which bits have changed (only enabled ones are of interest, PCINTn
+    // bits match PBn ones)
+    uint8_t changed_bits = (signals ^ signals_port_history) & PCMSK0;
+    // store current state as old one
+    signals_port_history = signals;
+
+    // HIGH to LOW pin change
+    if ( (changed_bits & (1<<TOUCH_SIGNAL_PIN)) && !(signals & (1<<TOUCH_SIGNAL_PIN)) ) {
+        ZMotor::stop();
+        // turn off touch tracking
+        PCMSK0 &= ~(1<<TOUCH_SIGNAL_INT);
+        if (state == WORK_STATE) {
+            // dive: get off the plate without waiting for the main loop
+            ZMotor::move(DIVE_RETRACT_STEPS);
+            state = DIVE_STATE;
+            if (dives < UINT8_MAX)
+                dives++;
+            event_post(DIVE_EVENT);
+        }
+        else {
+            probe_moving = false;
+            event_post(TOUCH_EVENT);
         }
     }
 
+    #ifdef HEIGHT_LOCK_SIGNAL
+        // LOW is the lock
+        if ( changed_bits & (1<<HEIGHT_LOCK_SIGNAL_PIN) ) {
+            bool lock = !(signals & (1<<HEIGHT_LOCK_SIGNAL_PIN));
+            regulator_hold(lock);
+            if (lock && state == WORK_STATE)
+                ZMotor::stop();
+        }
+    #endif
+
+    // the rest is debounced on the control timer tick, each edge is kept till then
+    if ( changed_bits & DEBOUNCED_SIGNALS )
+        input_capture(signals, control_clock_now());
+
+    PROFILE_ISR_END(PROFILE_SIGNALS_ISR);
 }